@@ -0,0 +1,114 @@
+// Cost of one server loop's pass over the delayed packets as the number pending grows.
+// The list is the old scheme, every node's remaining delay decremented and checked each pass,
+// the queue only looks at the earliest deadline.
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <list>
+
+#include "../src/DelayQueue.h"
+#include "../src/Random.h"
+
+struct ListDelayed {
+	double	delayMicroseconds;
+	int		payload;
+};
+
+// microseconds, spread over the delay range like -range does
+static uint64_t randomDelay(Random& random, double rangeSeconds) {
+	return (uint64_t)(random.randf() * rangeSeconds * 1000.0 * 1000.0);
+}
+
+// nanoseconds per loop pass with pending packets waiting, each pass advancing time by loopMicroseconds
+// and topping the pending count back up with whatever expired so it stays steady
+static double benchmarkList(unsigned int pending, unsigned int passes, double loopMicroseconds, double rangeSeconds, long long& sent) {
+	Random random(1, RANDOM_STREAM_FAULTS);
+	std::list<ListDelayed*> delayed;
+	for (unsigned int i = 0; i < pending; ++i)
+		delayed.push_back(new ListDelayed{ (double)randomDelay(random, rangeSeconds), (int)i });
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int pass = 0; pass < passes; ++pass) {
+		unsigned int expired = 0;
+		for (auto iter = delayed.begin(); iter != delayed.end(); ) {
+			(*iter)->delayMicroseconds -= loopMicroseconds;
+			if ((*iter)->delayMicroseconds <= 0) {
+				sent += (*iter)->payload;
+				delete (*iter);
+				iter = delayed.erase(iter);
+				++expired;
+			}
+			else
+				++iter;
+		}
+		for (unsigned int i = 0; i < expired; ++i)
+			delayed.push_back(new ListDelayed{ (double)randomDelay(random, rangeSeconds), (int)i });
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	for (auto d : delayed)
+		delete d;
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)passes;
+}
+
+static double benchmarkQueue(unsigned int pending, unsigned int passes, double loopMicroseconds, double rangeSeconds, long long& sent) {
+	Random random(1, RANDOM_STREAM_FAULTS);
+	DelayQueue<int> delayed;
+	for (unsigned int i = 0; i < pending; ++i)
+		delayed.push(randomDelay(random, rangeSeconds), (int)i);
+
+	double now = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int pass = 0; pass < passes; ++pass) {
+		now += loopMicroseconds;
+		unsigned int expired = 0;
+		int payload;
+		while (delayed.popExpired((uint64_t)now, payload)) {
+			sent += payload;
+			++expired;
+		}
+		for (unsigned int i = 0; i < expired; ++i)
+			delayed.push((uint64_t)now + randomDelay(random, rangeSeconds), (int)i);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / (double)passes;
+}
+
+int main(int argc, char* argv[]) {
+
+	std::cout << "Use command line options: -passes P -loop L -range Z" << std::endl << std::endl;
+
+	unsigned int passes = 20000;
+	double loopMicroseconds = 10;
+	double rangeSeconds = 1;
+
+	for (int i = 0; i < argc; ++i) {
+		if (strcmp(argv[i], "-passes") == 0)
+			passes = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-loop") == 0)
+			loopMicroseconds = atof(argv[i + 1]);
+		if (strcmp(argv[i], "-range") == 0)
+			rangeSeconds = atof(argv[i + 1]);
+	}
+
+	const unsigned int pendingCounts[] = { 0, 10, 100, 1000, 10000, 100000 };
+
+	std::cout << "Passes: " << passes << ", microseconds per loop: " << loopMicroseconds << ", delay range: " << rangeSeconds << std::endl << std::endl;
+	std::cout << std::setw(10) << "pending" << std::setw(16) << "list ns/pass" << std::setw(16) << "queue ns/pass" << std::endl;
+
+	// printed so the work can't be optimised away
+	long long sent = 0;
+	for (unsigned int pending : pendingCounts) {
+		double list = benchmarkList(pending, passes, loopMicroseconds, rangeSeconds, sent);
+		double queue = benchmarkQueue(pending, passes, loopMicroseconds, rangeSeconds, sent);
+		std::cout << std::setw(10) << pending << std::fixed << std::setprecision(1)
+			<< std::setw(16) << list << std::setw(16) << queue << std::endl;
+	}
+	std::cout << std::endl << "Checksum: " << sent << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,360 @@
+// Headless load test, opens N connections to a server from one process and decodes every entity list
+// the same way the client does, acknowledging completed snapshots so the server sends deltas.
+// Prints a summary at the end and writes per connection counts for each interval to a CSV file.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <csignal>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <RakPeerInterface.h>
+#include <MessageIdentifiers.h>
+#include <BitStream.h>
+#include <GetTime.h>
+
+#include "../src/AIEntity.h"
+#include "../src/Random.h"
+#include "../src/SnapshotReceiver.h"
+#include "../src/ClockSync.h"
+
+// latency histogram in whole milliseconds, anything later lands in the last bucket
+static const unsigned int LATENCY_BUCKETS = 5000;
+
+struct Counters {
+	unsigned long long	packets;
+	unsigned long long	bytes;
+	unsigned long long	completed;
+	unsigned long long	reordered;
+	unsigned long long	duplicates;
+	unsigned long long	rejected;		// stale, no baseline or malformed
+	unsigned long long	latencySum;
+	unsigned long long	latencySamples;
+	unsigned long long	latencyMax;
+};
+
+struct BotConnection {
+	RakNet::RakPeerInterface*	peer;
+	RakNet::SystemAddress		server;
+	bool						connected;
+	bool						failed;
+
+	SnapshotReceiver			receiver;
+
+	// latency is measured against this connection's estimate of the server's clock
+	ClockSync					clock;
+
+	// snapshot sequences seen, loss is whatever in the range never completed
+	bool						hasSequence;
+	unsigned int				firstSequence;
+	unsigned int				highestSequence;
+	unsigned int				intervalHighestSequence;
+
+	Counters					total;
+	Counters					interval;
+
+	// view reported to the server, so interest management has something to work with
+	float						viewX, viewY;
+};
+
+static volatile std::sig_atomic_t s_stopRequested = 0;
+
+static void requestStop(int) {
+	s_stopRequested = 1;
+}
+
+static void sendView(BotConnection& bot) {
+	RakNet::BitStream stream;
+	stream.Write((RakNet::MessageID)ID_CLIENT_VIEW);
+	stream.Write(bot.viewX);
+	stream.Write(bot.viewY);
+	bot.peer->Send(&stream, LOW_PRIORITY, UNRELIABLE, 0, bot.server, false);
+}
+
+static void receiveEntityList(BotConnection& bot, RakNet::Packet* packet, std::vector<unsigned long long>& latencies) {
+
+	++bot.interval.packets;
+	bot.interval.bytes += packet->length;
+
+	RakNet::Time timestamp = 0;
+	SnapshotReceiver::Result result = bot.receiver.receivePacket(packet->data, packet->length, timestamp);
+
+	// the timestamp is on the server's clock, one way latency needs an estimate of it
+	if (bot.clock.synchronised()) {
+		double age = bot.clock.serverTime(RakNet::GetTimeUS()) - (double)timestamp;
+		unsigned long long latency = age > 0 ? (unsigned long long)age : 0;
+		bot.interval.latencySum += latency;
+		++bot.interval.latencySamples;
+		if (latency > bot.interval.latencyMax)
+			bot.interval.latencyMax = latency;
+		++latencies[latency < LATENCY_BUCKETS ? latency : LATENCY_BUCKETS - 1];
+	}
+
+	if (result == SnapshotReceiver::SNAPSHOT_DUPLICATE) {
+		++bot.interval.duplicates;
+		return;
+	}
+	if (result != SnapshotReceiver::SNAPSHOT_CHUNK_DECODED) {
+		++bot.interval.rejected;
+		return;
+	}
+
+	const SnapshotHeader& header = bot.receiver.header();
+	if (!bot.hasSequence) {
+		bot.hasSequence = true;
+		bot.firstSequence = header.sequence;
+		bot.highestSequence = header.sequence;
+		bot.intervalHighestSequence = header.sequence - 1;
+	}
+	else if (bot.receiver.arrival() == SnapshotReceiveWindow::ARRIVAL_LATE)
+		++bot.interval.reordered;
+	else if (sequenceGreater(header.sequence, bot.highestSequence))
+		bot.highestSequence = header.sequence;
+
+	if (bot.receiver.completedSnapshot())
+		++bot.interval.completed;
+
+	RakNet::BitStream ack;
+	bot.receiver.writeAck(ack);
+	bot.peer->Send(&ack, HIGH_PRIORITY, UNRELIABLE, 0, packet->systemAddress, false);
+}
+
+static void addCounters(Counters& total, const Counters& interval) {
+	total.packets += interval.packets;
+	total.bytes += interval.bytes;
+	total.completed += interval.completed;
+	total.reordered += interval.reordered;
+	total.duplicates += interval.duplicates;
+	total.rejected += interval.rejected;
+	total.latencySum += interval.latencySum;
+	total.latencySamples += interval.latencySamples;
+	if (interval.latencyMax > total.latencyMax)
+		total.latencyMax = interval.latencyMax;
+}
+
+static unsigned int percentile(const std::vector<unsigned long long>& histogram, double fraction) {
+	unsigned long long count = 0;
+	for (unsigned long long n : histogram)
+		count += n;
+	unsigned long long target = (unsigned long long)(count * fraction);
+	unsigned long long seen = 0;
+	for (unsigned int i = 0; i < histogram.size(); ++i) {
+		seen += histogram[i];
+		if (seen > target)
+			return i;
+	}
+	return (unsigned int)histogram.size() - 1;
+}
+
+int main(int argc, char* argv[]) {
+
+	std::cout << "Use command line options: -connections N -host H -port P -duration D -interval I -csv F -views R -seed S" << std::endl;
+	std::cout << "N: connections to open as int (default - 100)" << std::endl;
+	std::cout << "H: server address (default - 127.0.0.1)" << std::endl;
+	std::cout << "P: server port as int (default - " << SERVER_PORT << ")" << std::endl;
+	std::cout << "D: seconds to run for as float, Ctrl+C stops early (default - 30)" << std::endl;
+	std::cout << "I: seconds between CSV rows as float (default - 1)" << std::endl;
+	std::cout << "F: CSV file to write (default - loadtest.csv)" << std::endl;
+	std::cout << "R: report a random view within this radius as float, 0 sends no view (default - 0)" << std::endl;
+	std::cout << "S: random seed for the views as int (default - 1)" << std::endl << std::endl;
+
+	unsigned int connectionCount = 100;
+	const char* host = "127.0.0.1";
+	unsigned short port = SERVER_PORT;
+	double duration = 30;
+	double intervalSeconds = 1;
+	const char* csvPath = "loadtest.csv";
+	float viewRadius = 0;
+	uint64_t seed = 1;
+
+	for (int i = 0; i < argc - 1; ++i) {
+		if (strcmp(argv[i], "-connections") == 0)
+			connectionCount = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-host") == 0)
+			host = argv[i + 1];
+		if (strcmp(argv[i], "-port") == 0)
+			port = (unsigned short)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-duration") == 0)
+			duration = atof(argv[i + 1]);
+		if (strcmp(argv[i], "-interval") == 0)
+			intervalSeconds = atof(argv[i + 1]);
+		if (strcmp(argv[i], "-csv") == 0)
+			csvPath = argv[i + 1];
+		if (strcmp(argv[i], "-views") == 0)
+			viewRadius = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-seed") == 0)
+			seed = strtoull(argv[i + 1], nullptr, 10);
+	}
+
+	std::cout << "Connections: " << connectionCount << ", server: " << host << ":" << port << ", duration: " << duration << "s" << std::endl;
+
+	std::ofstream csv(csvPath);
+	if (!csv) {
+		std::cout << "Could not open " << csvPath << std::endl;
+		return 1;
+	}
+	csv << "seconds,connection,packets,bytes,completed_snapshots,lost_snapshots,reordered,duplicates,rejected,latency_mean_ms,latency_max_ms" << std::endl;
+
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
+
+	// one peer per connection, the server sees each as its own client
+	Random random(seed, RANDOM_STREAM_SETUP);
+	std::vector<BotConnection> bots(connectionCount);
+	for (BotConnection& bot : bots) {
+		memset(&bot.total, 0, sizeof(bot.total));
+		memset(&bot.interval, 0, sizeof(bot.interval));
+		bot.connected = false;
+		bot.failed = false;
+		bot.hasSequence = false;
+		bot.firstSequence = bot.highestSequence = bot.intervalHighestSequence = 0;
+
+		float angle = random.randf() * 3.14159f * 2;
+		float distance = random.randf() * viewRadius;
+		bot.viewX = sinf(angle) * distance;
+		bot.viewY = cosf(angle) * distance;
+
+		bot.peer = RakNet::RakPeerInterface::GetInstance();
+		RakNet::SocketDescriptor sd;
+		if (bot.peer->Startup(1, &sd, 1) != RakNet::RAKNET_STARTED ||
+			bot.peer->Connect(host, port, nullptr, 0) != RakNet::CONNECTION_ATTEMPT_STARTED)
+			bot.failed = true;
+	}
+
+	std::vector<unsigned long long> latencies(LATENCY_BUCKETS, 0);
+	auto start = std::chrono::steady_clock::now();
+	double nextInterval = intervalSeconds;
+	double nextView = 0;
+
+	while (!s_stopRequested) {
+
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (elapsed >= duration)
+			break;
+
+		for (unsigned int i = 0; i < bots.size(); ++i) {
+			BotConnection& bot = bots[i];
+			if (bot.failed)
+				continue;
+
+			RakNet::Packet* packet;
+			for (packet = bot.peer->Receive(); packet; bot.peer->DeallocatePacket(packet), packet = bot.peer->Receive()) {
+				switch (packet->data[0]) {
+				case ID_CONNECTION_REQUEST_ACCEPTED:
+					bot.connected = true;
+					bot.server = packet->systemAddress;
+					if (viewRadius > 0)
+						sendView(bot);
+					break;
+				case ID_CONNECTION_ATTEMPT_FAILED:
+				case ID_NO_FREE_INCOMING_CONNECTIONS:
+				case ID_DISCONNECTION_NOTIFICATION:
+				case ID_CONNECTION_LOST:
+					bot.connected = false;
+					bot.failed = true;
+					break;
+				case ID_CLOCK_SYNC:
+					bot.clock.readReply(packet->data, packet->length, RakNet::GetTimeUS());
+					break;
+				case ID_ENTITY_LIST:
+					receiveEntityList(bot, packet, latencies);
+					break;
+				default:
+					break;
+				}
+			}
+		}
+
+		// each connection keeps its own estimate of the server's clock
+		RakNet::TimeUS now = RakNet::GetTimeUS();
+		for (BotConnection& bot : bots) {
+			if (bot.connected && bot.clock.requestDue(now)) {
+				RakNet::BitStream request;
+				bot.clock.writeRequest(request, now);
+				bot.peer->Send(&request, IMMEDIATE_PRIORITY, UNRELIABLE, 0, bot.server, false);
+			}
+		}
+
+		// views are a hint the server expects a few times a second, once a second is enough to keep it
+		if (viewRadius > 0 && elapsed >= nextView) {
+			nextView = elapsed + 1;
+			for (BotConnection& bot : bots) {
+				if (bot.connected)
+					sendView(bot);
+			}
+		}
+
+		if (elapsed >= nextInterval) {
+			for (unsigned int i = 0; i < bots.size(); ++i) {
+				BotConnection& bot = bots[i];
+				const Counters& c = bot.interval;
+				unsigned int advanced = bot.hasSequence ? bot.highestSequence - bot.intervalHighestSequence : 0;
+				unsigned long long lost = advanced > c.completed ? advanced - c.completed : 0;
+				csv << std::fixed << std::setprecision(3) << elapsed << "," << i << "," << c.packets << "," << c.bytes << ","
+					<< c.completed << "," << lost << "," << c.reordered << "," << c.duplicates << "," << c.rejected << ","
+					<< (c.latencySamples > 0 ? (double)c.latencySum / c.latencySamples : 0.0) << "," << c.latencyMax << std::endl;
+
+				addCounters(bot.total, bot.interval);
+				memset(&bot.interval, 0, sizeof(bot.interval));
+				bot.intervalHighestSequence = bot.highestSequence;
+			}
+			nextInterval += intervalSeconds;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// whatever is left of the last interval
+	Counters all;
+	memset(&all, 0, sizeof(all));
+	unsigned int connected = 0, failed = 0;
+	unsigned long long range = 0;
+	unsigned long long expectedPackets = 0, lostPackets = 0;
+	double slowestRate = -1;
+	for (BotConnection& bot : bots) {
+		addCounters(bot.total, bot.interval);
+		addCounters(all, bot.total);
+		expectedPackets += bot.receiver.stats().expectedPackets;
+		lostPackets += bot.receiver.stats().lostPackets;
+		if (bot.hasSequence)
+			range += bot.highestSequence - bot.firstSequence + 1;
+		if (bot.connected)
+			++connected;
+		if (bot.failed)
+			++failed;
+
+		double rate = bot.total.completed / seconds;
+		if (!bot.failed && (slowestRate < 0 || rate < slowestRate))
+			slowestRate = rate;
+	}
+
+	unsigned long long lost = range > all.completed ? range - all.completed : 0;
+	std::cout << std::endl << "Ran for " << std::fixed << std::setprecision(1) << seconds << "s" << std::endl;
+	std::cout << "Connections - connected: " << connected << ", failed or dropped: " << failed << std::endl;
+	std::cout << "Received - packets: " << all.packets << ", bytes: " << all.bytes
+		<< ", kbps per connection: " << (connectionCount > 0 ? all.bytes * 8 / 1000.0 / seconds / connectionCount : 0) << std::endl;
+	std::cout << "Snapshots - completed per second per connection: " << (connectionCount > 0 ? all.completed / seconds / connectionCount : 0)
+		<< ", slowest connection: " << (slowestRate > 0 ? slowestRate : 0) << std::endl;
+	std::cout << "Snapshots - lost: " << lost << " (" << (range > 0 ? 100.0 * lost / range : 0) << "%), reordered chunks: " << all.reordered
+		<< ", duplicate chunks: " << all.duplicates << ", rejected chunks: " << all.rejected << std::endl;
+	std::cout << "Packets - lost: " << lostPackets << " of " << expectedPackets << " (" << (expectedPackets > 0 ? 100.0 * lostPackets / expectedPackets : 0)
+		<< "%), compare with the server's -loss" << std::endl;
+	std::cout << "Latency ms - mean: " << (all.latencySamples > 0 ? (double)all.latencySum / all.latencySamples : 0)
+		<< ", median: " << percentile(latencies, 0.5) << ", 99th percentile: " << percentile(latencies, 0.99)
+		<< ", worst: " << all.latencyMax << std::endl;
+	std::cout << "Per interval counts written to " << csvPath << std::endl;
+
+	for (BotConnection& bot : bots) {
+		bot.peer->Shutdown(100);
+		RakNet::RakPeerInterface::DestroyInstance(bot.peer);
+	}
+
+	return 0;
+}
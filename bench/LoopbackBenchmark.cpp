@@ -0,0 +1,243 @@
+// End to end snapshot pipeline cost without sockets: a server and N client decoders in one process,
+// joined by the loopback transport. The server applies its loss and delay model on a virtual clock, so the
+// same options and seed give the same packets every run and only the encode and decode times vary.
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#include "../src/Server.h"
+#include "../src/SnapshotReceiver.h"
+#include "../src/AllocationCounter.h"
+
+static const uint64_t TICK_MICROSECONDS = 16666;
+
+struct BenchmarkClient {
+	SnapshotReceiver	receiver;
+	unsigned long long	completed;
+	unsigned long long	rejected;
+	unsigned long long	decoded;
+	unsigned long long	deltas;
+};
+
+// folds every decoded entity into one value, equal across runs with the same options
+static uint64_t hashEntities(uint64_t hash, const QuantizedEntity* entities, unsigned int first, unsigned int count) {
+	for (unsigned int i = 0; i < count; ++i) {
+		const QuantizedEntity& e = entities[i];
+		uint64_t values[] = { first + i, e.positionX, e.positionY, e.velocityX, e.velocityY, e.teleported ? 1u : 0u };
+		for (uint64_t v : values)
+			hash = randomMix(hash ^ v);
+	}
+	return hash;
+}
+
+int main(int argc, char* argv[]) {
+
+	std::cout << "Use command line options: -count N -clients C -ticks T -loss X -delay Y -range Z -latency L -upstreamloss U -chunk B -interest I -bandwidth W -seed S -warmup A -mindelta D" << std::endl;
+	std::cout << "N: entity count as int (default - 1000)" << std::endl;
+	std::cout << "C: clients as int (default - 16)" << std::endl;
+	std::cout << "T: ticks to run as int (default - 600)" << std::endl;
+	std::cout << "X: packetloss percentage as float (default - 10)" << std::endl;
+	std::cout << "Y: packet delay percentage as float (default - 10)" << std::endl;
+	std::cout << "Z: delay range in seconds as float (default - 1)" << std::endl;
+	std::cout << "L: one way latency in milliseconds as float (default - 0)" << std::endl;
+	std::cout << "U: percentage of acks and views lost on the way to the server as float (default - 0)" << std::endl;
+	std::cout << "B: largest entity list packet in bytes as int (default - 1200)" << std::endl;
+	std::cout << "I: interest radius, clients report a random view when set, as float (default - 0)" << std::endl;
+	std::cout << "W: entity list bandwidth per client in kbps as float (default - 0)" << std::endl;
+	std::cout << "S: random seed as int (default - 1)" << std::endl;
+	std::cout << "A: ticks for the server's pools and queues to grow, any heap allocation by a tick after them fails the run, with -delay above 0 a new high of packets in flight can still grow them, as int (default - 180)" << std::endl;
+	std::cout << "D: least percentage of decoded chunks that have to be deltas, fewer fails the run, as float (default - 0)" << std::endl << std::endl;
+
+	unsigned int entityCount = 1000;
+	unsigned int clientCount = 16;
+	unsigned int ticks = 600;
+	float packetlossPercentage = 10;
+	float delayPercentage = 10;
+	float delayRange = 1;
+	float latencyMilliseconds = 0;
+	float upstreamLossPercentage = 0;
+	unsigned int chunkBytes = 1200;
+	float interestRadius = 0;
+	float bandwidthKbps = 0;
+	uint64_t seed = 1;
+	unsigned int warmupTicks = 180;
+	float minimumDeltaPercentage = 0;
+	const float radius = 50;
+
+	for (int i = 0; i < argc - 1; ++i) {
+		if (strcmp(argv[i], "-count") == 0)
+			entityCount = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-clients") == 0)
+			clientCount = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-ticks") == 0)
+			ticks = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-loss") == 0)
+			packetlossPercentage = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-delay") == 0)
+			delayPercentage = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-range") == 0)
+			delayRange = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-latency") == 0)
+			latencyMilliseconds = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-upstreamloss") == 0)
+			upstreamLossPercentage = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-chunk") == 0)
+			chunkBytes = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-interest") == 0)
+			interestRadius = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-bandwidth") == 0)
+			bandwidthKbps = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-seed") == 0)
+			seed = strtoull(argv[i + 1], nullptr, 10);
+		if (strcmp(argv[i], "-warmup") == 0)
+			warmupTicks = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-mindelta") == 0)
+			minimumDeltaPercentage = (float)atof(argv[i + 1]);
+	}
+
+	// 0 sends each snapshot whole, anything else has to have room for at least one entity
+	unsigned int minimumChunkBytes = Server::minimumChunkBytes(radius, 0.01f);
+	if (chunkBytes > 0 && chunkBytes < minimumChunkBytes) {
+		std::cout << "Needs a chunk of at least " << minimumChunkBytes << " bytes, or 0 to not split snapshots" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Entities: " << entityCount << ", clients: " << clientCount << ", ticks: " << ticks
+		<< ", loss: " << packetlossPercentage << "%, delay: " << delayPercentage << "% up to " << delayRange << "s" << std::endl;
+
+	// the seed is offset for the upstream faults so acks aren't lost in step with snapshots
+	FaultModel upstreamFaults(upstreamLossPercentage, 0, 0, seed + 1);
+	LoopbackTransport transport(clientCount, (uint64_t)(latencyMilliseconds * 1000), upstreamFaults);
+
+	Server server(entityCount, radius, packetlossPercentage, delayPercentage, delayRange, 0.01f, chunkBytes, seed, 1, nullptr, interestRadius, bandwidthKbps);
+	server.attachLoopback(&transport);
+
+	std::vector<BenchmarkClient> clients(clientCount);
+	Random views(seed, RANDOM_STREAM_SETUP);
+	for (unsigned int i = 0; i < clientCount; ++i) {
+		clients[i].completed = 0;
+		clients[i].rejected = 0;
+		clients[i].decoded = 0;
+		clients[i].deltas = 0;
+
+		// a fixed view each, interest management only needs somewhere to look from
+		if (interestRadius > 0) {
+			float angle = views.randf() * 3.14159f * 2;
+			float distance = views.randf() * radius;
+			RakNet::BitStream view;
+			view.Write((RakNet::MessageID)ID_CLIENT_VIEW);
+			view.Write(sinf(angle) * distance);
+			view.Write(cosf(angle) * distance);
+			transport.sendToServer(i, view);
+		}
+	}
+
+	typedef std::chrono::steady_clock Clock;
+	double serverSeconds = 0;
+	double clientSeconds = 0;
+	uint64_t hash = 0;
+	RakNet::BitStream ack;
+
+	// only this thread's allocations, the clients' decoding below is not counted
+	unsigned long long steadyAllocations = 0;
+	unsigned int allocatingTicks = 0, firstAllocatingTick = 0;
+
+	for (unsigned int tick = 0; tick < ticks; ++tick) {
+
+		unsigned long long allocations = allocationCount();
+		Clock::time_point start = Clock::now();
+		server.stepLoopback();
+		Clock::time_point stepped = Clock::now();
+		allocations = allocationCount() - allocations;
+
+		if (tick >= warmupTicks && allocations > 0) {
+			if (allocatingTicks++ == 0)
+				firstAllocatingTick = tick;
+			steadyAllocations += allocations;
+		}
+
+		// everything due by the end of the tick
+		transport.advance(TICK_MICROSECONDS);
+
+		for (unsigned int i = 0; i < clientCount; ++i) {
+			BenchmarkClient& client = clients[i];
+			LoopbackTransport::Packet packet;
+			while (transport.receiveFromServer(i, packet)) {
+				RakNet::Time timestamp;
+				SnapshotReceiver::Result result = client.receiver.receivePacket(packet.data(), packet.length(), timestamp);
+				transport.release(packet);
+
+				if (result != SnapshotReceiver::SNAPSHOT_CHUNK_DECODED) {
+					if (result != SnapshotReceiver::SNAPSHOT_DUPLICATE)
+						++client.rejected;
+					continue;
+				}
+
+				hash = hashEntities(hash, client.receiver.chunkEntities(), client.receiver.header().firstEntity, client.receiver.chunkEntityCount());
+				++client.decoded;
+				if (client.receiver.header().hasBaseline)
+					++client.deltas;
+				if (client.receiver.completedSnapshot())
+					++client.completed;
+
+				ack.Reset();
+				client.receiver.writeAck(ack);
+				transport.sendToServer(i, ack);
+			}
+		}
+
+		serverSeconds += std::chrono::duration<double>(stepped - start).count();
+		clientSeconds += std::chrono::duration<double>(Clock::now() - stepped).count();
+	}
+
+	unsigned long long completed = 0, rejected = 0, decoded = 0, deltas = 0, late = 0, expectedPackets = 0, lostPackets = 0;
+	for (const BenchmarkClient& client : clients) {
+		completed += client.completed;
+		rejected += client.rejected;
+		decoded += client.decoded;
+		deltas += client.deltas;
+		late += client.receiver.stats().late;
+		expectedPackets += client.receiver.stats().expectedPackets;
+		lostPackets += client.receiver.stats().lostPackets;
+	}
+
+	double perTick = ticks > 0 ? 1.0 / ticks : 0;
+	double perClient = clientCount > 0 ? 1.0 / clientCount : 0;
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Server step us per tick (simulate, encode, fault model): " << serverSeconds * 1e6 * perTick << std::endl;
+	std::cout << "Client decode us per tick per client: " << clientSeconds * 1e6 * perTick * perClient << std::endl;
+	std::cout << "Bytes per tick per client: " << transport.bytesToClients() * perTick * perClient
+		<< ", packets: " << transport.packetsToClients() * perTick * perClient << std::endl;
+	std::cout << "Snapshots completed per client: " << completed * perClient << " of " << ticks
+		<< ", chunks rejected (stale or no baseline): " << rejected << ", acks lost: " << transport.upstreamLost() << std::endl;
+	std::cout << "Packets lost as the clients counted them: " << (expectedPackets > 0 ? 100.0 * lostPackets / expectedPackets : 0)
+		<< "% against -loss " << packetlossPercentage << "%, late: " << late << std::endl;
+	double deltaPercentage = decoded > 0 ? 100.0 * deltas / decoded : 0;
+	std::cout << "Decoded chunks that were deltas: " << deltaPercentage << "%" << std::endl;
+	std::cout << "Decoded entity hash, the same options give the same hash: " << std::hex << hash << std::dec << std::endl;
+
+	if (deltaPercentage < minimumDeltaPercentage) {
+		std::cout << "FAILED: " << deltaPercentage << "% of decoded chunks were deltas, -mindelta " << minimumDeltaPercentage << "%" << std::endl;
+		return 1;
+	}
+
+	if (!allocationCountingEnabled()) {
+		std::cout << "Allocations not counted, AllocationHooks.cpp is not linked" << std::endl;
+		return 0;
+	}
+	if (ticks <= warmupTicks) {
+		std::cout << "Allocations not checked, no ticks after the " << warmupTicks << " warm-up ticks" << std::endl;
+		return 0;
+	}
+	if (allocatingTicks > 0) {
+		std::cout << "FAILED: " << steadyAllocations << " heap allocations in " << allocatingTicks << " server ticks after warm-up, the first on tick " << firstAllocatingTick << std::endl;
+		return 1;
+	}
+	std::cout << "No heap allocations by the server in the " << ticks - warmupTicks << " ticks after warm-up" << std::endl;
+	return 0;
+}
@@ -0,0 +1,291 @@
+// Accuracy of the client's reconciliation techniques against the true entity paths.
+// Records a run of the server's simulation, delivers its snapshots through the loss and delay model, then replays
+// the same arrivals through the jitter buffer and each reconciliation blend, comparing what would be drawn with where
+// the entities really were at the render time. Run once with the adaptive interpolation delay and once with none,
+// where everything is extrapolated like plain dead reckoning and the blends have the most to correct.
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "../src/AIEntityStore.h"
+#include "../src/AIEntityKernel.h"
+#include "../src/Random.h"
+#include "../src/FaultModel.h"
+#include "../src/Snapshot.h"
+#include "../src/SnapshotJitterBuffer.h"
+#include "../src/EntityReconciler.h"
+
+struct Recording {
+	unsigned int					entityCount;
+	unsigned int					ticks;
+	SnapshotFormat					format;
+	std::vector<RakNet::Time>		times;			// per tick, on the server's clock
+	std::vector<float>				positionX;		// per tick per entity, the true path
+	std::vector<float>				positionY;
+	std::vector<unsigned char>		nearTeleport;	// per tick per entity, within TELEPORT_MARGIN ticks of a teleport
+	std::vector<QuantizedEntity>	snapshots;		// per tick per entity, what was sent
+};
+
+// a lost teleport snapshot leaves the client interpolating across the arena, so the error around any teleport
+// says more about the loss than the reconciliation and is left out
+static const unsigned int TELEPORT_MARGIN = 30;
+
+struct Arrival {
+	unsigned int	tick;
+	double			time;
+};
+
+struct ReplayResult {
+	double			rmsError;
+	double			maxError;
+	double			rmsPop;			// per frame jump away from where the last frame was heading
+	double			maxPop;
+	unsigned int	blends;
+	unsigned int	snaps;
+};
+
+static void record(Recording& recording, unsigned int entityCount, unsigned int ticks, uint64_t seed) {
+
+	const float radius = 50;
+	AIWanderParams params = { 1 / 60.0f, radius, 10, 0.05f, 2.5f, 1.5f };
+
+	recording.entityCount = entityCount;
+	recording.ticks = ticks;
+	recording.format.setPrecision(radius, params.maxVelocity, 0.01f);
+	recording.times.resize(ticks);
+	recording.positionX.resize((size_t)ticks * entityCount);
+	recording.positionY.resize((size_t)ticks * entityCount);
+	recording.nearTeleport.assign((size_t)ticks * entityCount, 0);
+	recording.snapshots.resize((size_t)ticks * entityCount);
+
+	// the same starting state and jitter as the server with this seed
+	AIEntityStore store;
+	store.resize(entityCount);
+	Random setup(seed, RANDOM_STREAM_SETUP);
+	for (unsigned int i = 0; i < entityCount; ++i) {
+		float facing = setup.randf() * 3.14159f * 2;
+		float offsetDir = setup.randf() * 3.14159f * 2;
+		float offset = radius * setup.randf();
+		store.wanderAngle[i] = setup.randf() * 3.14159f * 2;
+		store.positionX[i] = sinf(offsetDir) * offset;
+		store.positionY[i] = cosf(offsetDir) * offset;
+		store.velocityX[i] = sinf(facing) * params.maxVelocity;
+		store.velocityY[i] = cosf(facing) * params.maxVelocity;
+		store.teleported[i] = 0;
+	}
+
+	std::vector<float> jitter(entityCount);
+	for (unsigned int tick = 0; tick < ticks; ++tick) {
+		for (unsigned int i = 0; i < entityCount; ++i)
+			jitter[i] = randomCounterf(seed, RANDOM_STREAM_SIMULATION, tick, i) * 2 - 1;
+		updateEntitiesScalar(store, jitter.data(), 0, entityCount, params);
+
+		// a second in so nothing is ever before the start of the clock
+		recording.times[tick] = (RakNet::Time)(1000 + tick * 1000.0 / 60 + 0.5);
+		size_t row = (size_t)tick * entityCount;
+		std::copy(store.positionX.begin(), store.positionX.end(), recording.positionX.begin() + row);
+		std::copy(store.positionY.begin(), store.positionY.end(), recording.positionY.begin() + row);
+		for (unsigned int i = 0; i < entityCount; ++i) {
+			if (!store.teleported[i])
+				continue;
+			unsigned int from = tick > TELEPORT_MARGIN ? tick - TELEPORT_MARGIN : 0;
+			unsigned int to = std::min(tick + TELEPORT_MARGIN, ticks - 1);
+			for (unsigned int t = from; t <= to; ++t)
+				recording.nearTeleport[(size_t)t * entityCount + i] = 1;
+		}
+		store.quantize(recording.format, recording.snapshots.data() + row, 0, entityCount);
+	}
+}
+
+static void deliver(const Recording& recording, FaultModel faults, double latency, std::vector<Arrival>& arrivals) {
+	arrivals.clear();
+	for (unsigned int tick = 0; tick < recording.ticks; ++tick) {
+		uint64_t delay;
+		if (!faults.apply(delay))
+			continue;
+		Arrival arrival = { tick, recording.times[tick] + latency + delay / 1000.0 };
+		arrivals.push_back(arrival);
+	}
+	std::stable_sort(arrivals.begin(), arrivals.end(), [](const Arrival& a, const Arrival& b) { return a.time < b.time; });
+}
+
+static ReplayResult replay(const Recording& recording, const std::vector<Arrival>& arrivals, double maxDelay, const ReconcileSettings& settings, double fps) {
+
+	SnapshotJitterBuffer buffer;
+	buffer.setMaxDelay(maxDelay);
+	EntityReconciler reconciler(settings);
+
+	SnapshotHeader header;
+	header.hasBaseline = false;
+	header.baselineSequence = 0;
+	header.chunkIndex = 0;
+	header.chunkCount = 1;
+	header.firstEntity = 0;
+	header.totalEntities = recording.entityCount;
+	header.entitiesPerChunk = recording.entityCount;
+	header.format = recording.format;
+
+	std::vector<AIEntity> target, displayed, previous;
+	double frame = 1000.0 / fps;
+	float deltaTime = (float)(frame / 1000.0);
+
+	// the first second settles the clock and delay estimates
+	double start = recording.times[0];
+	double measureFrom = start + 1000;
+	double end = recording.times[recording.ticks - 1];
+
+	double errorSum = 0, maxError = 0, popSum = 0, maxPop = 0;
+	unsigned long long errorCount = 0, popCount = 0;
+	size_t next = 0;
+	unsigned int tick = 0;
+
+	for (double now = start; now < end; now += frame) {
+
+		for (; next < arrivals.size() && arrivals[next].time <= now; ++next) {
+			header.sequence = arrivals[next].tick + 1;
+			buffer.insert(header, recording.times[arrivals[next].tick], arrivals[next].time,
+				recording.snapshots.data() + (size_t)arrivals[next].tick * recording.entityCount, nullptr, recording.entityCount);
+		}
+
+		buffer.sample(now, deltaTime, target);
+		if (target.empty())
+			continue;
+		previous = displayed;
+		reconciler.update(target, deltaTime, displayed);
+
+		// the true positions either side of the render time
+		double t = buffer.renderTime();
+		while (tick + 1 < recording.ticks && recording.times[tick + 1] <= t)
+			++tick;
+		if (now < measureFrom || t < recording.times[0] || tick + 1 >= recording.ticks)
+			continue;
+		float alpha = (float)((t - recording.times[tick]) / (recording.times[tick + 1] - recording.times[tick]));
+		size_t a = (size_t)tick * recording.entityCount;
+		size_t b = a + recording.entityCount;
+
+		for (unsigned int i = 0; i < recording.entityCount; ++i) {
+
+			if (recording.nearTeleport[a + i] || recording.nearTeleport[b + i])
+				continue;
+
+			float trueX = recording.positionX[a + i] + (recording.positionX[b + i] - recording.positionX[a + i]) * alpha;
+			float trueY = recording.positionY[a + i] + (recording.positionY[b + i] - recording.positionY[a + i]) * alpha;
+			double error = std::sqrt((double)(displayed[i].position.x - trueX) * (displayed[i].position.x - trueX) +
+				(double)(displayed[i].position.y - trueY) * (displayed[i].position.y - trueY));
+			errorSum += error * error;
+			maxError = std::max(maxError, error);
+			++errorCount;
+
+			if (previous.size() == displayed.size()) {
+				double popX = displayed[i].position.x - (previous[i].position.x + previous[i].velocity.x * deltaTime);
+				double popY = displayed[i].position.y - (previous[i].position.y + previous[i].velocity.y * deltaTime);
+				double pop = popX * popX + popY * popY;
+				popSum += pop;
+				maxPop = std::max(maxPop, std::sqrt(pop));
+				++popCount;
+			}
+		}
+	}
+
+	ReplayResult result;
+	result.rmsError = errorCount > 0 ? std::sqrt(errorSum / errorCount) : 0;
+	result.maxError = maxError;
+	result.rmsPop = popCount > 0 ? std::sqrt(popSum / popCount) : 0;
+	result.maxPop = maxPop;
+	result.blends = reconciler.blends();
+	result.snaps = reconciler.snaps();
+	return result;
+}
+
+int main(int argc, char* argv[]) {
+
+	std::cout << "Use command line options: -count N -seconds T -loss X -delay Y -range Z -latency L -fps F -blend B -snap D -seed S" << std::endl;
+	std::cout << "N: entity count as int (default - 200)" << std::endl;
+	std::cout << "T: seconds of simulation to record as float (default - 30)" << std::endl;
+	std::cout << "X: packetloss percentage as float (default - 10)" << std::endl;
+	std::cout << "Y: packet delay percentage as float (default - 10)" << std::endl;
+	std::cout << "Z: delay range in seconds as float (default - 0.5)" << std::endl;
+	std::cout << "L: one way latency in milliseconds as float (default - 50)" << std::endl;
+	std::cout << "F: client frames per second as float (default - 144)" << std::endl;
+	std::cout << "B: blend time in seconds as float (default - 0.1)" << std::endl;
+	std::cout << "D: errors above this distance snap as float, 0 always blends (default - 5)" << std::endl;
+	std::cout << "S: random seed as int (default - 1)" << std::endl << std::endl;
+
+	unsigned int entityCount = 200;
+	float seconds = 30;
+	float packetlossPercentage = 10;
+	float delayPercentage = 10;
+	float delayRange = 0.5f;
+	float latency = 50;
+	float fps = 144;
+	float blendTime = 0.1f;
+	float snapDistance = 5;
+	uint64_t seed = 1;
+
+	for (int i = 0; i < argc - 1; ++i) {
+		if (strcmp(argv[i], "-count") == 0)
+			entityCount = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-seconds") == 0)
+			seconds = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-loss") == 0)
+			packetlossPercentage = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-delay") == 0)
+			delayPercentage = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-range") == 0)
+			delayRange = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-latency") == 0)
+			latency = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-fps") == 0)
+			fps = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-blend") == 0)
+			blendTime = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-snap") == 0)
+			snapDistance = (float)atof(argv[i + 1]);
+		if (strcmp(argv[i], "-seed") == 0)
+			seed = strtoull(argv[i + 1], nullptr, 10);
+	}
+
+	unsigned int ticks = (unsigned int)(seconds * 60);
+	if (entityCount == 0 || ticks < 120 || fps <= 0) {
+		std::cout << "Needs at least one entity, two seconds and a frame rate" << std::endl;
+		return 1;
+	}
+
+	Recording recording;
+	record(recording, entityCount, ticks, seed);
+
+	std::vector<Arrival> arrivals;
+	deliver(recording, FaultModel(packetlossPercentage, delayPercentage, delayRange, seed), latency, arrivals);
+
+	std::cout << "Entities: " << entityCount << ", ticks: " << ticks << ", delivered: " << arrivals.size()
+		<< ", loss: " << packetlossPercentage << "%, delay: " << delayPercentage << "% up to " << delayRange << "s, latency: " << latency << "ms" << std::endl;
+	std::cout << "Error is the distance from the true position at the render time, pop is each frame's jump off the path the last frame was on" << std::endl << std::endl;
+
+	const char* blends[] = { "snap", "projective", "hermite" };
+	const double maxDelays[] = { 250, 0 };
+	const char* modes[] = { "interpolated", "extrapolated" };
+
+	std::cout << std::left << std::setw(14) << "Mode" << std::setw(12) << "Blend" << std::right << std::setw(12) << "RMS error" << std::setw(12) << "Max error"
+		<< std::setw(12) << "RMS pop" << std::setw(12) << "Max pop" << std::setw(10) << "Blends" << std::setw(10) << "Snaps" << std::endl;
+
+	for (unsigned int m = 0; m < 2; ++m) {
+		for (const char* name : blends) {
+			ReconcileSettings settings;
+			settings.blend = selectReconcileBlend(name, &name);
+			settings.blendTime = blendTime;
+			settings.snapDistance = snapDistance;
+
+			ReplayResult result = replay(recording, arrivals, maxDelays[m], settings, fps);
+			std::cout << std::left << std::setw(14) << modes[m] << std::setw(12) << name << std::right << std::fixed << std::setprecision(4)
+				<< std::setw(12) << result.rmsError << std::setw(12) << result.maxError << std::setw(12) << result.rmsPop << std::setw(12) << result.maxPop
+				<< std::setw(10) << result.blends << std::setw(10) << result.snaps << std::endl;
+		}
+	}
+
+	return 0;
+}
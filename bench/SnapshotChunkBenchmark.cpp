@@ -0,0 +1,169 @@
+// Delivered entity updates per second against datagram loss, for chunked and monolithic snapshots.
+// A monolithic snapshot bigger than one datagram is split by RakNet and lost if any of its fragments are,
+// a chunked snapshot loses only the chunks whose datagram was dropped, and only their ranges lose a baseline.
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "../src/AIEntityStore.h"
+#include "../src/AIEntityKernel.h"
+#include "../src/Random.h"
+#include "../src/Snapshot.h"
+#include "../src/SnapshotSender.h"
+#include "../src/SnapshotReceiver.h"
+
+// payload RakNet fits in one datagram once the UDP/IP and reliability layer headers are taken off a 1492 byte MTU
+static const unsigned int DATAGRAM_PAYLOAD_BYTES = 1400;
+
+// bytes in front of the snapshot header: the message id and the timestamp
+static const unsigned int PACKET_PREFIX_BYTES = 9;
+
+static const float ARENA_RADIUS = 50;
+static const float MAX_VELOCITY = 10;
+
+static SnapshotFormat benchmarkFormat() {
+	SnapshotFormat format;
+	format.setPrecision(ARENA_RADIUS, MAX_VELOCITY, 0.01f);
+	return format;
+}
+
+struct BenchmarkResult {
+	unsigned long long	entityUpdates;
+	unsigned long long	datagrams;
+	unsigned int		completedSnapshots;
+};
+
+static BenchmarkResult runBenchmark(unsigned int entityCount, unsigned int ticks, float lossPercentage, unsigned int chunkBytes, uint64_t seed) {
+
+	const float radius = ARENA_RADIUS;
+	AIWanderParams params = { 1 / 60.0f, radius, MAX_VELOCITY, 0.05f, 2.5f, 1.5f };
+	SnapshotFormat format = benchmarkFormat();
+
+	// same starting state for every run
+	AIEntityStore store;
+	store.resize(entityCount);
+	Random setup(seed, RANDOM_STREAM_SETUP);
+	for (unsigned int i = 0; i < entityCount; ++i) {
+		float facing = setup.randf() * 3.14159f * 2;
+		float offsetDir = setup.randf() * 3.14159f * 2;
+		float offset = radius * setup.randf();
+		store.wanderAngle[i] = setup.randf() * 3.14159f * 2;
+		store.positionX[i] = sinf(offsetDir) * offset;
+		store.positionY[i] = cosf(offsetDir) * offset;
+		store.velocityX[i] = sinf(facing) * params.maxVelocity;
+		store.velocityY[i] = cosf(facing) * params.maxVelocity;
+		store.teleported[i] = 0;
+	}
+
+	std::vector<float> jitter(entityCount);
+	SnapshotHistory history;
+	SnapshotSender sender;
+	SnapshotReceiver receiver;
+	Random loss(seed, RANDOM_STREAM_FAULTS);
+	std::vector<QuantizedEntity> baselineScratch, entityScratch;
+	RakNet::BitStream stream;
+
+	SnapshotHeader header;
+	header.format = format;
+	unsigned int entitiesPerChunk = snapshotEntitiesPerChunk(format, entityCount, chunkBytes);
+
+	BenchmarkResult result = { 0, 0, 0 };
+	for (unsigned int tick = 1; tick <= ticks; ++tick) {
+
+		for (unsigned int i = 0; i < entityCount; ++i)
+			jitter[i] = randomCounterf(seed, RANDOM_STREAM_SIMULATION, tick, i) * 2 - 1;
+		updateEntitiesScalar(store, jitter.data(), 0, entityCount, params);
+
+		std::vector<QuantizedEntity>& snapshot = history.prepare(tick);
+		snapshot.resize(entityCount);
+		store.quantize(format, snapshot.data(), 0, entityCount);
+		history.commit(tick);
+
+		SnapshotDelta delta;
+		sender.selectBaseline(history, tick, entitiesPerChunk, baselineScratch, delta);
+		sender.selectEntities(history, format, tick, nullptr, entityScratch, delta);
+		header.sequence = tick;
+
+		for (unsigned int c = 0; c < delta.chunkCount; ++c) {
+			stream.Reset();
+			writeSnapshotChunk(stream, header, delta, c);
+
+			// the packet only arrives if every datagram it was split into does
+			unsigned int bytes = stream.GetNumberOfBytesUsed() + PACKET_PREFIX_BYTES;
+			unsigned int datagrams = (bytes + DATAGRAM_PAYLOAD_BYTES - 1) / DATAGRAM_PAYLOAD_BYTES;
+			result.datagrams += datagrams;
+
+			bool delivered = true;
+			for (unsigned int d = 0; d < datagrams; ++d) {
+				if (loss.randf() * 100 < lossPercentage)
+					delivered = false;
+			}
+			if (!delivered)
+				continue;
+
+			RakNet::BitStream received(stream.GetData(), stream.GetNumberOfBytesUsed(), false);
+			if (receiver.receive(received) != SnapshotReceiver::SNAPSHOT_CHUNK_DECODED)
+				continue;
+
+			result.entityUpdates += receiver.chunkEntityCount();
+
+			// acks are assumed to make it back before the next tick
+			sender.acknowledge(tick, c);
+			if (receiver.completedSnapshot())
+				++result.completedSnapshots;
+		}
+	}
+	return result;
+}
+
+int main(int argc, char* argv[]) {
+
+	std::cout << "Use command line options: -count N -ticks T -chunk C -seed S" << std::endl << std::endl;
+
+	unsigned int entityCount = 5000;
+	unsigned int ticks = 600;
+	unsigned int chunkBytes = 1200;
+	uint64_t seed = 1;
+
+	for (int i = 0; i < argc - 1; ++i) {
+		if (strcmp(argv[i], "-count") == 0)
+			entityCount = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-ticks") == 0)
+			ticks = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-chunk") == 0)
+			chunkBytes = (unsigned int)atoi(argv[i + 1]);
+		if (strcmp(argv[i], "-seed") == 0)
+			seed = strtoull(argv[i + 1], nullptr, 10);
+	}
+
+	// 0 sends each snapshot whole, anything else has to have room for at least one entity
+	unsigned int minimumChunkBytes = snapshotMinimumChunkBytes(benchmarkFormat());
+	if (chunkBytes > 0 && chunkBytes < minimumChunkBytes) {
+		std::cout << "Needs a chunk of at least " << minimumChunkBytes << " bytes, or 0 to not split snapshots" << std::endl;
+		return 1;
+	}
+
+	const float lossRates[] = { 0, 1, 2, 5, 10, 20, 30, 50 };
+	double seconds = ticks / 60.0;
+
+	std::cout << "Entities: " << entityCount << ", ticks: " << ticks << ", chunk bytes: " << chunkBytes << std::endl << std::endl;
+	std::cout << std::setw(8) << "loss %"
+		<< std::setw(18) << "chunked upd/s" << std::setw(12) << "complete"
+		<< std::setw(18) << "monolithic upd/s" << std::setw(12) << "complete" << std::endl;
+
+	for (float lossPercentage : lossRates) {
+		BenchmarkResult chunked = runBenchmark(entityCount, ticks, lossPercentage, chunkBytes, seed);
+		BenchmarkResult monolithic = runBenchmark(entityCount, ticks, lossPercentage, 0, seed);
+
+		std::cout << std::setw(8) << lossPercentage
+			<< std::setw(18) << (unsigned long long)(chunked.entityUpdates / seconds)
+			<< std::setw(12) << chunked.completedSnapshots
+			<< std::setw(18) << (unsigned long long)(monolithic.entityUpdates / seconds)
+			<< std::setw(12) << monolithic.completedSnapshots << std::endl;
+	}
+
+	return 0;
+}
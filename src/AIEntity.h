@@ -6,8 +6,23 @@
 enum GameMessages {
 	// this ID is used for sending the AI entities
 	// the structure of the bitstream is:
-	// [ message ID, unsigned int bytecount, AIEntity array of size (bytecount / sizeof(AIEntity)) ]
+	// [ message ID, RakNet::Time, SnapshotHeader, unsigned int count, count quantised entities ]
+	// the time is the server's clock when the snapshot was taken, left as it is so clients can use their ClockSync estimate
+	// each packet holds one self-contained chunk of a snapshot, see Snapshot.h for the entity packing
 	ID_ENTITY_LIST = ID_USER_PACKET_ENUM + 1,
+
+	// sent by clients for each entity list they decode, so the server can delta that chunk's range against it
+	// [ message ID, unsigned int snapshot sequence, unsigned short chunk index ]
+	ID_SNAPSHOT_ACK,
+
+	// sent by clients a few times a second so the server can favour entities near what they are looking at
+	// [ message ID, float x, float y ] in entity space
+	ID_CLIENT_VIEW,
+
+	// clock synchronisation, see ClockSync.h
+	// client to server [ message ID, RakNet::TimeUS sent ]
+	// server to client [ message ID, RakNet::TimeUS client sent, RakNet::TimeUS server received, RakNet::TimeUS server sent ]
+	ID_CLOCK_SYNC,
 };
 
 static const unsigned short SERVER_PORT = 5456;
@@ -44,11 +59,4 @@ struct AIEntity
 	AIVector velocity;
 	bool teleported;
 };
-//#pragma pack(pop)
-
-// server's entity data that it uses to update entities
-struct AIServerEntity 
-{
-	AIEntity* data;
-	float wanderAngle;
-};
\ No newline at end of file
+//#pragma pack(pop)
\ No newline at end of file
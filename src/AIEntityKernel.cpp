@@ -0,0 +1,356 @@
+// Vectorised sin/cos follows the Cephes sinf/cosf range reduction and polynomials: http://www.netlib.org/cephes/
+
+#include "AIEntityKernel.h"
+#include <cmath>
+#include <cstring>
+
+#ifdef AI_KERNEL_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AI_TARGET_AVX2
+#else
+#define AI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+void updateEntitiesScalar(AIEntityStore& store, const float* jitter, unsigned int first, unsigned int count, const AIWanderParams& params) {
+
+	float* px = store.positionX.data();
+	float* py = store.positionY.data();
+	float* vx = store.velocityX.data();
+	float* vy = store.velocityY.data();
+	float* wander = store.wanderAngle.data();
+	unsigned char* teleported = store.teleported.data();
+
+	for (unsigned int i = first; i < first + count; ++i) {
+
+		// jitter offset
+		wander[i] += jitter[i - first] * params.wanderJitter;
+
+		AIVector f = { vx[i], vy[i] };
+		f.normalise();
+
+		// wander force
+		vx[i] += sinf(wander[i]) * params.wanderRadius + f.x * params.wanderOffset;
+		vy[i] += cosf(wander[i]) * params.wanderRadius + f.y * params.wanderOffset;
+
+		// truncate
+		AIVector v = { vx[i], vy[i] };
+		if (v.lengthSqr() > (params.maxVelocity * params.maxVelocity)) {
+			v.normalise();
+			vx[i] = v.x * params.maxVelocity;
+			vy[i] = v.y * params.maxVelocity;
+		}
+
+		// move
+		px[i] += vx[i] * params.deltaTime;
+		py[i] += vy[i] * params.deltaTime;
+
+		teleported[i] = 0;
+
+		// teleport if needed to stay in arena
+		AIVector offset = { px[i], py[i] };
+		if (offset.lengthSqr() > (params.arenaRadius * params.arenaRadius)) {
+			teleported[i] = 1;
+			offset.normalise();
+			px[i] -= offset.x * params.arenaRadius * 2;
+			py[i] -= offset.y * params.arenaRadius * 2;
+		}
+	}
+}
+
+#ifdef AI_KERNEL_X86
+
+// pi/2 split into three parts so the range reduction stays accurate for large angles
+static const float PIO2_1 = 1.5703125f;
+static const float PIO2_2 = 4.837512969970703125e-4f;
+static const float PIO2_3 = 7.54978995489188216e-8f;
+static const float TWO_OVER_PI = 0.636619772367581343f;
+
+static const float SIN_P0 = -1.9515295891e-4f;
+static const float SIN_P1 = 8.3321608736e-3f;
+static const float SIN_P2 = -1.6666654611e-1f;
+static const float COS_P0 = 2.443315711809948e-5f;
+static const float COS_P1 = -1.388731625493765e-3f;
+static const float COS_P2 = 4.166664568298827e-2f;
+
+// sine and cosine of 4 angles at once
+static inline void sincos4(__m128 x, __m128& s, __m128& c) {
+
+	// quadrant and remainder in [-pi/4, pi/4]
+	__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)));
+	__m128 qf = _mm_cvtepi32_ps(q);
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(qf, _mm_set1_ps(PIO2_1)));
+	r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(PIO2_2)));
+	r = _mm_sub_ps(r, _mm_mul_ps(qf, _mm_set1_ps(PIO2_3)));
+
+	__m128 z = _mm_mul_ps(r, r);
+
+	__m128 ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+	ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(SIN_P2));
+	ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), r), r);
+
+	__m128 pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+	pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(COS_P2));
+	pc = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(pc, z), z), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(z, _mm_set1_ps(0.5f))));
+
+	// odd quadrants swap sin and cos
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	__m128 sinr = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+	__m128 cosr = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+
+	// sin is negated in quadrants 2,3 and cos in quadrants 1,2
+	__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+	s = _mm_xor_ps(sinr, sinSign);
+	c = _mm_xor_ps(cosr, cosSign);
+}
+
+void updateEntitiesSSE2(AIEntityStore& store, const float* jitter, unsigned int first, unsigned int count, const AIWanderParams& params) {
+
+	float* px = store.positionX.data();
+	float* py = store.positionY.data();
+	float* vx = store.velocityX.data();
+	float* vy = store.velocityY.data();
+	float* wander = store.wanderAngle.data();
+	unsigned char* teleported = store.teleported.data();
+
+	const __m128 dt = _mm_set1_ps(params.deltaTime);
+	const __m128 wanderJitter = _mm_set1_ps(params.wanderJitter);
+	const __m128 wanderOffset = _mm_set1_ps(params.wanderOffset);
+	const __m128 wanderRadius = _mm_set1_ps(params.wanderRadius);
+	const __m128 maxVelocity = _mm_set1_ps(params.maxVelocity);
+	const __m128 maxVelocitySqr = _mm_set1_ps(params.maxVelocity * params.maxVelocity);
+	const __m128 arenaRadiusSqr = _mm_set1_ps(params.arenaRadius * params.arenaRadius);
+	const __m128 arenaDiameter = _mm_set1_ps(params.arenaRadius * 2);
+
+	unsigned int end = first + count;
+	unsigned int i = first;
+	for (; i + 4 <= end; i += 4) {
+
+		// jitter offset
+		__m128 w = _mm_add_ps(_mm_loadu_ps(wander + i), _mm_mul_ps(_mm_loadu_ps(jitter + (i - first)), wanderJitter));
+		_mm_storeu_ps(wander + i, w);
+
+		__m128 x = _mm_loadu_ps(vx + i);
+		__m128 y = _mm_loadu_ps(vy + i);
+
+		// heading
+		__m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))));
+		__m128 fx = _mm_mul_ps(x, invLength);
+		__m128 fy = _mm_mul_ps(y, invLength);
+
+		// wander force
+		__m128 s, c;
+		sincos4(w, s, c);
+		x = _mm_add_ps(x, _mm_add_ps(_mm_mul_ps(s, wanderRadius), _mm_mul_ps(fx, wanderOffset)));
+		y = _mm_add_ps(y, _mm_add_ps(_mm_mul_ps(c, wanderRadius), _mm_mul_ps(fy, wanderOffset)));
+
+		// truncate, lanes under the limit keep a scale of 1
+		__m128 lengthSqr = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+		__m128 truncate = _mm_cmpgt_ps(lengthSqr, maxVelocitySqr);
+		__m128 scale = _mm_div_ps(maxVelocity, _mm_sqrt_ps(lengthSqr));
+		scale = _mm_or_ps(_mm_and_ps(truncate, scale), _mm_andnot_ps(truncate, _mm_set1_ps(1.0f)));
+		x = _mm_mul_ps(x, scale);
+		y = _mm_mul_ps(y, scale);
+		_mm_storeu_ps(vx + i, x);
+		_mm_storeu_ps(vy + i, y);
+
+		// move
+		__m128 ppx = _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(x, dt));
+		__m128 ppy = _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(y, dt));
+
+		// teleport if needed to stay in arena
+		__m128 distanceSqr = _mm_add_ps(_mm_mul_ps(ppx, ppx), _mm_mul_ps(ppy, ppy));
+		__m128 teleport = _mm_cmpgt_ps(distanceSqr, arenaRadiusSqr);
+		__m128 jump = _mm_and_ps(teleport, _mm_div_ps(arenaDiameter, _mm_sqrt_ps(distanceSqr)));
+		ppx = _mm_sub_ps(ppx, _mm_mul_ps(ppx, jump));
+		ppy = _mm_sub_ps(ppy, _mm_mul_ps(ppy, jump));
+		_mm_storeu_ps(px + i, ppx);
+		_mm_storeu_ps(py + i, ppy);
+
+		int mask = _mm_movemask_ps(teleport);
+		for (int lane = 0; lane < 4; ++lane)
+			teleported[i + lane] = (unsigned char)((mask >> lane) & 1);
+	}
+
+	// remaining entities
+	if (i < end)
+		updateEntitiesScalar(store, jitter + (i - first), i, end - i, params);
+}
+
+// sine and cosine of 8 angles at once
+AI_TARGET_AVX2 static inline void sincos8(__m256 x, __m256& s, __m256& c) {
+
+	// quadrant and remainder in [-pi/4, pi/4]
+	__m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)));
+	__m256 qf = _mm256_cvtepi32_ps(q);
+	__m256 r = _mm256_sub_ps(x, _mm256_mul_ps(qf, _mm256_set1_ps(PIO2_1)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(PIO2_2)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(qf, _mm256_set1_ps(PIO2_3)));
+
+	__m256 z = _mm256_mul_ps(r, r);
+
+	__m256 ps = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_P0), z), _mm256_set1_ps(SIN_P1));
+	ps = _mm256_add_ps(_mm256_mul_ps(ps, z), _mm256_set1_ps(SIN_P2));
+	ps = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ps, z), r), r);
+
+	__m256 pc = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_P0), z), _mm256_set1_ps(COS_P1));
+	pc = _mm256_add_ps(_mm256_mul_ps(pc, z), _mm256_set1_ps(COS_P2));
+	pc = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(pc, z), z), _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(z, _mm256_set1_ps(0.5f))));
+
+	// odd quadrants swap sin and cos
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	__m256 sinr = _mm256_blendv_ps(ps, pc, swap);
+	__m256 cosr = _mm256_blendv_ps(pc, ps, swap);
+
+	// sin is negated in quadrants 2,3 and cos in quadrants 1,2
+	__m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30));
+	__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+	s = _mm256_xor_ps(sinr, sinSign);
+	c = _mm256_xor_ps(cosr, cosSign);
+}
+
+AI_TARGET_AVX2 void updateEntitiesAVX2(AIEntityStore& store, const float* jitter, unsigned int first, unsigned int count, const AIWanderParams& params) {
+
+	float* px = store.positionX.data();
+	float* py = store.positionY.data();
+	float* vx = store.velocityX.data();
+	float* vy = store.velocityY.data();
+	float* wander = store.wanderAngle.data();
+	unsigned char* teleported = store.teleported.data();
+
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 dt = _mm256_set1_ps(params.deltaTime);
+	const __m256 wanderJitter = _mm256_set1_ps(params.wanderJitter);
+	const __m256 wanderOffset = _mm256_set1_ps(params.wanderOffset);
+	const __m256 wanderRadius = _mm256_set1_ps(params.wanderRadius);
+	const __m256 maxVelocity = _mm256_set1_ps(params.maxVelocity);
+	const __m256 maxVelocitySqr = _mm256_set1_ps(params.maxVelocity * params.maxVelocity);
+	const __m256 arenaRadiusSqr = _mm256_set1_ps(params.arenaRadius * params.arenaRadius);
+	const __m256 arenaDiameter = _mm256_set1_ps(params.arenaRadius * 2);
+
+	unsigned int end = first + count;
+	unsigned int i = first;
+	for (; i + 8 <= end; i += 8) {
+
+		// jitter offset
+		__m256 w = _mm256_add_ps(_mm256_loadu_ps(wander + i), _mm256_mul_ps(_mm256_loadu_ps(jitter + (i - first)), wanderJitter));
+		_mm256_storeu_ps(wander + i, w);
+
+		__m256 x = _mm256_loadu_ps(vx + i);
+		__m256 y = _mm256_loadu_ps(vy + i);
+
+		// heading
+		__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y))));
+		__m256 fx = _mm256_mul_ps(x, invLength);
+		__m256 fy = _mm256_mul_ps(y, invLength);
+
+		// wander force
+		__m256 s, c;
+		sincos8(w, s, c);
+		x = _mm256_add_ps(x, _mm256_add_ps(_mm256_mul_ps(s, wanderRadius), _mm256_mul_ps(fx, wanderOffset)));
+		y = _mm256_add_ps(y, _mm256_add_ps(_mm256_mul_ps(c, wanderRadius), _mm256_mul_ps(fy, wanderOffset)));
+
+		// truncate, lanes under the limit keep a scale of 1
+		__m256 lengthSqr = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+		__m256 truncate = _mm256_cmp_ps(lengthSqr, maxVelocitySqr, _CMP_GT_OQ);
+		__m256 scale = _mm256_blendv_ps(one, _mm256_div_ps(maxVelocity, _mm256_sqrt_ps(lengthSqr)), truncate);
+		x = _mm256_mul_ps(x, scale);
+		y = _mm256_mul_ps(y, scale);
+		_mm256_storeu_ps(vx + i, x);
+		_mm256_storeu_ps(vy + i, y);
+
+		// move
+		__m256 ppx = _mm256_add_ps(_mm256_loadu_ps(px + i), _mm256_mul_ps(x, dt));
+		__m256 ppy = _mm256_add_ps(_mm256_loadu_ps(py + i), _mm256_mul_ps(y, dt));
+
+		// teleport if needed to stay in arena
+		__m256 distanceSqr = _mm256_add_ps(_mm256_mul_ps(ppx, ppx), _mm256_mul_ps(ppy, ppy));
+		__m256 teleport = _mm256_cmp_ps(distanceSqr, arenaRadiusSqr, _CMP_GT_OQ);
+		__m256 jump = _mm256_and_ps(teleport, _mm256_div_ps(arenaDiameter, _mm256_sqrt_ps(distanceSqr)));
+		ppx = _mm256_sub_ps(ppx, _mm256_mul_ps(ppx, jump));
+		ppy = _mm256_sub_ps(ppy, _mm256_mul_ps(ppy, jump));
+		_mm256_storeu_ps(px + i, ppx);
+		_mm256_storeu_ps(py + i, ppy);
+
+		int mask = _mm256_movemask_ps(teleport);
+		for (int lane = 0; lane < 8; ++lane)
+			teleported[i + lane] = (unsigned char)((mask >> lane) & 1);
+	}
+
+	// remaining entities
+	if (i < end)
+		updateEntitiesSSE2(store, jitter + (i - first), i, end - i, params);
+}
+
+static bool cpuSupportsSSE2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+static bool cpuSupportsAVX2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// the OS must also save the YMM registers on a context switch
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+AIUpdateKernel selectUpdateKernel(const char* preferred, const char** selectedName) {
+
+	struct Candidate {
+		const char*		name;
+		AIUpdateKernel	kernel;
+		bool			supported;
+	};
+
+	// widest first
+	Candidate candidates[] = {
+#ifdef AI_KERNEL_X86
+		{ "avx2", updateEntitiesAVX2, cpuSupportsAVX2() },
+		{ "sse2", updateEntitiesSSE2, cpuSupportsSSE2() },
+#endif
+		{ "scalar", updateEntitiesScalar, true },
+	};
+	const unsigned int candidateCount = sizeof(candidates) / sizeof(candidates[0]);
+
+	const Candidate* selected = nullptr;
+	for (unsigned int i = 0; i < candidateCount && selected == nullptr; ++i) {
+		if (candidates[i].supported &&
+			(preferred == nullptr || strcmp(preferred, candidates[i].name) == 0))
+			selected = &candidates[i];
+	}
+
+	// unknown or unsupported preference, fall back to the widest available
+	for (unsigned int i = 0; i < candidateCount && selected == nullptr; ++i) {
+		if (candidates[i].supported)
+			selected = &candidates[i];
+	}
+
+	if (selectedName != nullptr)
+		*selectedName = selected->name;
+	return selected->kernel;
+}
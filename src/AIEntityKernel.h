@@ -0,0 +1,35 @@
+#pragma once
+
+#include "../src/AIEntityStore.h"
+
+// constants used by the wander / steer / integrate step
+struct AIWanderParams
+{
+	float deltaTime;
+	float arenaRadius;
+	float maxVelocity;
+	float wanderJitter;
+	float wanderOffset;
+	float wanderRadius;
+};
+
+// updates entities [first, first + count) of the store
+// jitter holds one random value in [-1,1] per entity, indexed from first
+typedef void(*AIUpdateKernel)(AIEntityStore& store, const float* jitter, unsigned int first, unsigned int count, const AIWanderParams& params);
+
+// reference implementation, one entity at a time
+void	updateEntitiesScalar(AIEntityStore& store, const float* jitter, unsigned int first, unsigned int count, const AIWanderParams& params);
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define AI_KERNEL_X86 1
+
+// 4 entities per iteration
+void	updateEntitiesSSE2(AIEntityStore& store, const float* jitter, unsigned int first, unsigned int count, const AIWanderParams& params);
+
+// 8 entities per iteration
+void	updateEntitiesAVX2(AIEntityStore& store, const float* jitter, unsigned int first, unsigned int count, const AIWanderParams& params);
+#endif
+
+// returns the widest kernel the running CPU supports
+// if preferred is not null and names a supported kernel ("scalar", "sse2", "avx2") that one is used instead
+AIUpdateKernel	selectUpdateKernel(const char* preferred, const char** selectedName);
@@ -0,0 +1,21 @@
+#include "AIEntityStore.h"
+
+void AIEntityStore::resize(unsigned int count) {
+	positionX.resize(count);
+	positionY.resize(count);
+	velocityX.resize(count);
+	velocityY.resize(count);
+	wanderAngle.resize(count);
+	teleported.resize(count);
+}
+
+void AIEntityStore::quantize(const SnapshotFormat& format, QuantizedEntity* out, unsigned int first, unsigned int count) const {
+	for (unsigned int i = first; i < first + count; ++i) {
+		QuantizedEntity& e = out[i - first];
+		e.positionX = format.quantizePosition(positionX[i]);
+		e.positionY = format.quantizePosition(positionY[i]);
+		e.velocityX = format.quantizeVelocity(velocityX[i]);
+		e.velocityY = format.quantizeVelocity(velocityY[i]);
+		e.teleported = teleported[i] != 0;
+	}
+}
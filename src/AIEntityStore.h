@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+
+#include "../src/AIEntity.h"
+#include "../src/Snapshot.h"
+
+// server-side entity storage laid out as a structure of arrays
+// each field lives in its own contiguous array so the update loop only
+// streams through the data it touches, and nothing is reached through a pointer
+struct AIEntityStore
+{
+	std::vector<float>			positionX;
+	std::vector<float>			positionY;
+	std::vector<float>			velocityX;
+	std::vector<float>			velocityY;
+
+	// this data is NOT sent to clients, handles wandering
+	std::vector<float>			wanderAngle;
+
+	// 0 or 1, stored as bytes rather than std::vector<bool> so it can be indexed directly
+	std::vector<unsigned char>	teleported;
+
+	void			resize(unsigned int count);
+	unsigned int	size() const { return (unsigned int)positionX.size(); }
+
+	// quantises entities [first, first + count) for the wire, the id is implied by the array index
+	void			quantize(const SnapshotFormat& format, QuantizedEntity* out, unsigned int first, unsigned int count) const;
+};
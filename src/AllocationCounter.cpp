@@ -0,0 +1,21 @@
+#include "AllocationCounter.h"
+
+// per thread so a tick only counts what its own thread allocated, not raknet's or the network thread's
+static thread_local unsigned long long t_allocations = 0;
+static bool s_enabled = false;
+
+unsigned long long allocationCount() {
+	return t_allocations;
+}
+
+bool allocationCountingEnabled() {
+	return s_enabled;
+}
+
+void countAllocation() {
+	++t_allocations;
+}
+
+void enableAllocationCounting() {
+	s_enabled = true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// counts heap allocations per thread, used to check that the server loop makes none once it reaches a steady state
+// the counts only move in programs that link AllocationHooks.cpp, which replaces the global operator new,
+// so the server itself pays nothing unless it is built with AIE_COUNT_ALLOCATIONS
+unsigned long long	allocationCount();
+
+// false if AllocationHooks.cpp is not linked and allocationCount() is always 0
+bool				allocationCountingEnabled();
+
+// called by the hooks
+void				countAllocation();
+void				enableAllocationCounting();
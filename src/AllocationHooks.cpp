@@ -0,0 +1,103 @@
+// replaces the global operator new and points RakNet's allocators at counting ones, so AllocationCounter sees
+// every allocation including a BitStream growing its buffer, which RakNet does with rakMalloc_Ex / rakRealloc_Ex
+// linked into the benchmarks, and into the server only when it is built with AIE_COUNT_ALLOCATIONS
+
+#include "AllocationCounter.h"
+#include <RakMemoryOverride.h>
+#include <cstdlib>
+#include <new>
+
+static void* countedAllocate(std::size_t size) {
+	countAllocation();
+	return std::malloc(size > 0 ? size : 1);
+}
+
+// a realloc that moves or grows the block is as much an allocation as a malloc
+static void* countedReallocate(void* p, std::size_t size) {
+	countAllocation();
+	return std::realloc(p, size);
+}
+
+static void* rakCountedMalloc(size_t size) {
+	return countedAllocate(size);
+}
+
+static void* rakCountedRealloc(void* p, size_t size) {
+	return countedReallocate(p, size);
+}
+
+static void rakFreeCounted(void* p) {
+	std::free(p);
+}
+
+static void* rakCountedMallocEx(size_t size, const char*, unsigned int) {
+	return countedAllocate(size);
+}
+
+static void* rakCountedReallocEx(void* p, size_t size, const char*, unsigned int) {
+	return countedReallocate(p, size);
+}
+
+static void rakFreeCountedEx(void* p, const char*, unsigned int) {
+	std::free(p);
+}
+
+static bool installHooks() {
+	SetMalloc(rakCountedMalloc);
+	SetRealloc(rakCountedRealloc);
+	SetFree(rakFreeCounted);
+	SetMalloc_Ex(rakCountedMallocEx);
+	SetRealloc_Ex(rakCountedReallocEx);
+	SetFree_Ex(rakFreeCountedEx);
+	enableAllocationCounting();
+	return true;
+}
+
+// RakNet's allocator pointers are constant initialised, so they are already set when this runs
+static const bool s_enabled = installHooks();
+
+void* operator new(std::size_t size) {
+	void* p = countedAllocate(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size) {
+	void* p = countedAllocate(size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return countedAllocate(size);
+}
+
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
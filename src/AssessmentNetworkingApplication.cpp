@@ -24,23 +24,40 @@
 
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <chrono>
 
 #include <RakPeerInterface.h>
 #include <MessageIdentifiers.h>
 #include <BitStream.h>
+#include <GetTime.h>
 
 #include "Gizmos.h"
 #include "Camera.h"
+#include "EntityRenderer.h"
+#include "SnapshotReceiver.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#if defined(_WIN32)
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
 using glm::vec3;
 using glm::vec4;
 
 AssessmentNetworkingApplication::AssessmentNetworkingApplication() 
 : m_camera(nullptr),
-m_peerInterface(nullptr) {}
+m_entityRenderer(nullptr),
+m_statsTimer(0),
+m_running(false),
+m_viewX(0),
+m_viewY(0),
+m_packetsReceived(0),
+m_peerInterface(nullptr),
+m_connected(false) {}
 
 AssessmentNetworkingApplication::~AssessmentNetworkingApplication() {}
 
@@ -50,6 +67,7 @@ bool AssessmentNetworkingApplication::startup()
 	createWindow("Client Application", 1280, 720);
 
 	Gizmos::create();
+	m_entityRenderer = new EntityRenderer();
 
 	// set up basic camera
 	m_camera = new Camera(glm::pi<GLfloat>() * 0.25f, 16 / 9.f, 0.1f, 1000.f);
@@ -82,22 +100,36 @@ bool AssessmentNetworkingApplication::startup()
 	RakNet::ConnectionAttemptResult res = m_peerInterface->Connect(ipAddress.c_str(), SERVER_PORT, nullptr, 0);
 
 	// Timestamping 
-	m_uiPrevTimeStamp = 0;
 	m_uiCurrentTimeStamp = 0;
 
+	// Snapshot history
+	m_snapshotReceiver.clear();
+	m_jitterBuffer.clear();
+	m_clockSync.clear();
+	m_reconciler.clear();
+
 	if (res != RakNet::CONNECTION_ATTEMPT_STARTED) 
 	{
 		std::cout << "Unable to start connection, Error number: " << res << std::endl;
 		return false;
 	}
 
+	// from here on only the network thread touches the peer
+	m_running = true;
+	m_networkThread = std::thread([this]() { networkLoop(); });
+
 	return true;
 }
 
 GLvoid AssessmentNetworkingApplication::shutdown() 
 {
+	m_running = false;
+	if (m_networkThread.joinable())
+		m_networkThread.join();
+
 	// delete our camera and cleanup gizmos
 	delete m_camera;
+	delete m_entityRenderer;
 	Gizmos::destroy();
 
 	// destroy our window properly
@@ -137,140 +169,24 @@ bool AssessmentNetworkingApplication::update(GLfloat deltaTime)
 	// update camera
 	m_camera->update(deltaTime);
 
-	// handle network messages
-	RakNet::Packet* packet;
-	for (packet = m_peerInterface->Receive(); packet;
-		m_peerInterface->DeallocatePacket(packet),
-		packet = m_peerInterface->Receive()) 
-	{
-		switch (GetPacketIdentifier(packet))
-		{
-		case ID_CONNECTION_REQUEST_ACCEPTED:
-			std::cout << "Our connection request has been accepted." << std::endl;
-			break;
-		case ID_CONNECTION_ATTEMPT_FAILED:
-			std::cout << "Our connection request failed!" << std::endl;
-			break;
-		case ID_NO_FREE_INCOMING_CONNECTIONS:
-			std::cout << "The server is full." << std::endl;
-			break;
-		case ID_DISCONNECTION_NOTIFICATION:
-			std::cout << "We have been disconnected." << std::endl;
-			break;
-		case ID_CONNECTION_LOST:
-			std::cout << "Connection lost." << std::endl;
-			break;
-		case ID_ENTITY_LIST:
-		{
-			// receive list of entities
-			RakNet::BitStream stream(packet->data, packet->length, false);
-			stream.IgnoreBytes(sizeof(RakNet::MessageID)); // Ignore the ID_TIMESTAMP message.
-			stream.IgnoreBytes(sizeof(RakNet::MessageID)); // Ignore the ID_ENTITY_LIST message.
-			stream.Read(m_uiCurrentTimeStamp);
-			unsigned int size = 0;
-			stream.Read(size);
-
-			// used to determine whether it's the first time we are running
-			bool isFirstRun = false;
-			// determines whether a timestamp/ packet is delayed
-			bool isOutOfOrder = false;
-
-			// if first time receiving entities...
-			if (m_aiEntities.size() == 0)
-			{
-				// ... resize our vector, otherwise...
-				m_aiEntities.resize(size / sizeof(AIEntity));
-				// set our current time stamp to our previous
-				m_uiPrevTimeStamp = m_uiCurrentTimeStamp;
-				isFirstRun = true;
-			}
-			// if it's the second time running, assign our current entites data to our previous.
-			else
-			{
-				// set the current entites to the previous,
-				m_aiPrevEntities = m_aiEntities;
-			}
-
-			// Setting current entites.
-			stream.Read((char*)m_aiEntities.data(), size);
-
-			// Will help determine if a packet is lost if data is out of our defined range.
-			GLfloat fRange = 25.0f;
-
-			// Reads on the first run.
-			if (isFirstRun)
-			{
-				// set our current data to our previous to avoid a memory fault
-				m_aiPrevEntities = m_aiEntities;
-				continue;
-			}
-
-			/// --------------------------------------
-			/// <summary>
-			/// To account for packet loss/ stuttering.
-			/// Checks our timestamp sent with the packet, and
-			/// for lost packets by identifying whether data has exceeded our range.
-			/// If so, adjusts the entites position.
-			/// </summary> 
-			/// --------------------------------------
-			for (GLuint i = 0; i < m_aiEntities.size(); ++i)
-			{
-				// Our current data
-				AIEntity& ai = m_aiEntities[i];
-				// Previous data
-				AIEntity& pAI = m_aiPrevEntities[i];
-				// Expected position based off previous position and velocity data
-				glm::vec2 v2ExpectedPos(pAI.position.x + pAI.velocity.x * deltaTime, pAI.position.y + pAI.velocity.y * deltaTime);
-				glm::vec2 v2CurrentPos(ai.position.x, ai.position.y); // Current Position data
-				glm::vec2 v2CurrentVel(ai.velocity.x, ai.velocity.y); // Current Velocity data
-
-				// if packet is out of order (based off the timestamp)...
-				if (m_uiCurrentTimeStamp < m_uiPrevTimeStamp)
-				{
-					// ...use our previous data
-					ai = pAI;
-					isOutOfOrder = true;
-				}
-				// ... else if our distance from our expected position is outside our range, and we haven't teleported
-				else if (glm::distance(v2ExpectedPos, v2CurrentPos) > fRange && !ai.teleported)
-				{
-					//std::cout << "Entity " << ai.id << " moved." << std::endl;
-
-					/// <summary>
-					/// lerp from our previous velocity to our current velocity over time.
-					/// <example> Lerp = fma(t, v1, fma(-t, v0, v0)) </example> 
-					/// </summary> 
-					ai.velocity.x = glm::mix(pAI.velocity.x, v2CurrentVel.x, deltaTime);
-					ai.velocity.y = glm::mix(pAI.velocity.y, v2CurrentVel.y, deltaTime);
-				}
-			}
-
-			// if our data is valid...
-			if (!isOutOfOrder)
-			{
-				// ...set current time stamp to the previous.
-				m_uiPrevTimeStamp = m_uiCurrentTimeStamp;
-			}
-
-			break;
-		}
-		default:
-			std::cout << "Received unhandled message." << std::endl;
-			break;
-		}
+	// the network thread sends it on a few times a second
+	updateView();
+
+	m_frameTimes.record(deltaTime);
+	m_statsTimer += deltaTime;
+	if (m_statsTimer >= STATS_INTERVAL) {
+		m_statsTimer = 0;
+		// written in one go, the network thread prints its own stats
+		std::ostringstream out;
+		out << "Entity list packets received: " << m_packetsReceived.exchange(0) << std::endl;
+		m_frameTimes.print(out);
+		std::cout << out.str();
+		m_frameTimes.reset();
 	}
 
-	// Predictive movement: predict movement without receiving packets.
-	// Dead Reckoning: adjusts the entites positions
-	for (GLuint i = 0; i < m_aiEntities.size(); ++i)
-	{
-		AIEntity& ai = m_aiEntities[i];
-		glm::vec2 v2ExpectedPos(ai.position.x + ai.velocity.x * deltaTime, ai.position.y + ai.velocity.y * deltaTime);
-
-		// set our position to where we expect to be
-		ai.position.x = v2ExpectedPos.x;
-		ai.position.y = v2ExpectedPos.y;
-	}
+	// the newest state the network thread has reconciled, a single swap with nothing to wait on
+	// draw() reads it straight from the buffer, taking it also tells the network thread to reconcile the next
+	m_world.acquire();
 
 	Gizmos::clear();
 
@@ -287,30 +203,202 @@ bool AssessmentNetworkingApplication::update(GLfloat deltaTime)
 	return true;
 }
 
-GLvoid AssessmentNetworkingApplication::draw()
+void AssessmentNetworkingApplication::updateView()
 {
-	// clear the screen for this frame
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// the point on the ground the camera faces, or the point under it when looking up
+	vec3 position(m_camera->getTransform()[3]);
+	vec3 forward = -vec3(m_camera->getTransform()[2]);
+	vec3 view = position;
+	if (forward.y < -0.0001f)
+		view = position + forward * (-position.y / forward.y);
+
+	// entities live on the XZ plane
+	m_viewX.store(view.x, std::memory_order_relaxed);
+	m_viewY.store(view.z, std::memory_order_relaxed);
+}
+
+void AssessmentNetworkingApplication::sendView()
+{
+	if (!m_connected)
+		return;
+
+	RakNet::BitStream stream;
+	stream.Write((RakNet::MessageID)ID_CLIENT_VIEW);
+	stream.Write(m_viewX.load(std::memory_order_relaxed));
+	stream.Write(m_viewY.load(std::memory_order_relaxed));
+	m_peerInterface->Send(&stream, LOW_PRIORITY, UNRELIABLE, 0, m_serverAddress, false);
+}
+
+void AssessmentNetworkingApplication::networkLoop()
+{
+#if defined(_WIN32)
+	// default timer resolution is 15.6ms, the sleep below would step arrival times by that much
+	timeBeginPeriod(1);
+#endif
+
+	// when entities were last sampled, the jitter buffer and reconciler step by the time since
+	RakNet::TimeUS previous = RakNet::GetTimeUS();
+	RakNet::TimeUS nextView = previous;
+	RakNet::TimeUS nextStats = previous + RECEIVE_STATS_INTERVAL;
+
+	while (m_running)
+	{
+		RakNet::TimeUS now = RakNet::GetTimeUS();
+
+		// the view is only a hint, a few times a second is plenty
+		if (now >= nextView)
+		{
+			nextView = now + VIEW_INTERVAL;
+			sendView();
+		}
+
+		if (now >= nextStats)
+		{
+			nextStats = now + RECEIVE_STATS_INTERVAL;
+			printReceiveStats();
+		}
+
+		// keep estimating the server's clock, quickly at first
+		if (m_connected && m_clockSync.requestDue(now))
+		{
+			RakNet::BitStream request;
+			m_clockSync.writeRequest(request, now);
+			m_peerInterface->Send(&request, IMMEDIATE_PRIORITY, UNRELIABLE, 0, m_serverAddress, false);
+		}
+
+		// handle network messages
+		bool buffered = false;
+		RakNet::Packet* packet;
+		for (packet = m_peerInterface->Receive(); packet;
+			m_peerInterface->DeallocatePacket(packet),
+			packet = m_peerInterface->Receive()) 
+		{
+			buffered |= handlePacket(packet);
+		}
+
+		// Interpolation: draw entities slightly in the past, between the snapshots either side of that time.
+		// Predictive movement only when the buffer runs dry: extrapolates along the last velocity by the snapshot's age on the server's clock.
+		// Corrections to an extrapolation are blended in rather than snapped, teleports jump straight there.
+		// Only redone when a snapshot came in or the render thread took the last result, in between it extrapolates that.
+		if (m_clockSync.synchronised() && (buffered || m_world.consumed()))
+		{
+			now = RakNet::GetTimeUS();
+			float deltaTime = (float)((now - previous) / 1000000.0);
+			previous = now;
+
+			WorldState& world = m_world.back();
+			m_jitterBuffer.sample(m_clockSync.serverTime(now), deltaTime, m_targetEntities);
+			m_reconciler.update(m_targetEntities, deltaTime, world.entities);
+			world.sampledAt = now;
+			m_world.publish();
+		}
 
-	// draw entities
-	for (auto& ai : m_aiEntities) 
+		std::this_thread::sleep_for(std::chrono::milliseconds(NETWORK_SLEEP_MILLISECONDS));
+	}
+
+#if defined(_WIN32)
+	timeEndPeriod(1);
+#endif
+}
+
+bool AssessmentNetworkingApplication::handlePacket(RakNet::Packet* packet)
+{
+	switch (GetPacketIdentifier(packet))
 	{
-		vec3 p1 = vec3(ai.position.x + ai.velocity.x * 0.25f, 0, ai.position.y + ai.velocity.y * 0.25f);
-		vec3 p2 = vec3(ai.position.x, 0, ai.position.y) - glm::cross(vec3(ai.velocity.x, 0, ai.velocity.y), vec3(0, 1, 0)) * 0.1f;
-		vec3 p3 = vec3(ai.position.x, 0, ai.position.y) + glm::cross(vec3(ai.velocity.x, 0, ai.velocity.y), vec3(0, 1, 0)) * 0.1f;
-		// if the id is not equal to 1...
-		if (ai.id != 1)
+	case ID_CONNECTION_REQUEST_ACCEPTED:
+		std::cout << "Our connection request has been accepted." << std::endl;
+		m_serverAddress = packet->systemAddress;
+		m_connected = true;
+		sendView();
+		break;
+	case ID_CONNECTION_ATTEMPT_FAILED:
+		std::cout << "Our connection request failed!" << std::endl;
+		break;
+	case ID_NO_FREE_INCOMING_CONNECTIONS:
+		std::cout << "The server is full." << std::endl;
+		break;
+	case ID_DISCONNECTION_NOTIFICATION:
+		std::cout << "We have been disconnected." << std::endl;
+		m_connected = false;
+		break;
+	case ID_CONNECTION_LOST:
+		std::cout << "Connection lost." << std::endl;
+		m_connected = false;
+		break;
+	case ID_CLOCK_SYNC:
+		m_clockSync.readReply(packet->data, packet->length, RakNet::GetTimeUS());
+		break;
+	case ID_ENTITY_LIST:
+	{
+		m_packetsReceived.fetch_add(1, std::memory_order_relaxed);
+
+		// receive list of entities, decoding this chunk of the snapshot, ids are implied by their index
+		SnapshotReceiver::Result result = m_snapshotReceiver.receivePacket(packet->data, packet->length, m_uiCurrentTimeStamp);
+		if (result == SnapshotReceiver::SNAPSHOT_MALFORMED)
 		{
-			// ... set the colour to red...
-			Gizmos::addTri(p1, p2, p3, glm::vec4(1, 0, 0, 1));
+			std::cout << "Received a malformed entity list." << std::endl;
+			break;
 		}
-		// ... else set the colour to pink
-		else
+		// stale, duplicated, or a delta against a snapshot we no longer have: wait for the next one
+		// stale and duplicate chunks are turned away by their sequence before anything is decoded
+		if (result != SnapshotReceiver::SNAPSHOT_CHUNK_DECODED)
 		{
-			Gizmos::addTri(p1, p2, p3, glm::vec4(1, 0, 1, 1));
+			break;
 		}
+
+		// let the server know it can send this chunk's range as deltas against it
+		RakNet::BitStream ack;
+		m_snapshotReceiver.writeAck(ack);
+		m_peerInterface->Send(&ack, HIGH_PRIORITY, UNRELIABLE, 0, packet->systemAddress, false);
+
+		// buffered by timestamp rather than applied, late and out of order chunks slot in where they belong
+		// only the chunk's own entities are written, several arriving in one pass are sampled once
+		// the timestamp is on the server's clock, so nothing is buffered until we have an estimate of it
+		if (m_clockSync.synchronised())
+		{
+			m_jitterBuffer.insert(m_snapshotReceiver.header(), m_uiCurrentTimeStamp, m_clockSync.serverTime(RakNet::GetTimeUS()),
+				m_snapshotReceiver.chunkEntities(), m_snapshotReceiver.chunkUpdated(), m_snapshotReceiver.chunkEntityCount());
+			return true;
+		}
+
+		break;
 	}
+	default:
+		std::cout << "Received unhandled message." << std::endl;
+		break;
+	}
+	return false;
+}
+
+void AssessmentNetworkingApplication::printReceiveStats()
+{
+	const SnapshotReceiveStats& stats = m_snapshotReceiver.stats();
+	if (stats.inOrder + stats.late + stats.gaps == 0)
+		return;
+
+	// written in one go, the render thread prints its frame times
+	std::ostringstream out;
+	out << "Entity list packets - in order: " << stats.inOrder << ", late: " << stats.late << ", gaps: " << stats.gaps
+		<< " (" << stats.skippedSnapshots << " skipped), stale: " << stats.stale << ", duplicates: " << stats.duplicates << std::endl;
+	out << "Lost packets: " << stats.lostPackets << " of " << stats.expectedPackets << " (" << stats.packetLossPercentage()
+		<< "%), whole snapshots lost: " << stats.lostSnapshots << ", interpolation delay ms: " << m_jitterBuffer.delay() << std::endl;
+	out << "Server clock offset ms: " << m_clockSync.offset() << ", round trip ms: " << m_clockSync.roundTrip() << std::endl;
+	out << "Corrections - blended: " << m_reconciler.blends() << ", snapped: " << m_reconciler.snaps() << ", teleports: " << m_reconciler.teleports() << std::endl;
+	std::cout << out.str();
+}
+
+GLvoid AssessmentNetworkingApplication::draw()
+{
+	// clear the screen for this frame
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// display the 3D gizmos
 	Gizmos::draw(m_camera->getProjectionView());
+
+	// draw entities, one instanced draw with the arrows built in the vertex shader
+	// the state is from the network thread's last pass, so the renderer moves each entity on along its velocity to now
+	const WorldState& world = m_world.front();
+	RakNet::TimeUS now = RakNet::GetTimeUS();
+	float age = now > world.sampledAt ? (float)((now - world.sampledAt) / 1000000.0) : 0;
+	m_entityRenderer->draw(world.entities, age, m_camera->getProjectionView());
 }
\ No newline at end of file
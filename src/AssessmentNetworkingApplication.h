@@ -1,11 +1,21 @@
 #pragma once
 
 #include "AIEntity.h"
+#include "SnapshotReceiver.h"
+#include "SnapshotJitterBuffer.h"
+#include "ClockSync.h"
+#include "EntityReconciler.h"
+#include "TripleBuffer.h"
+#include "FrameTimeHistogram.h"
 #include "BaseApplication.h"
 #include <RakNetTime.h>
+#include <RakNetTypes.h>
 #include <vector>
+#include <thread>
+#include <atomic>
 
 class Camera;
+class EntityRenderer;
 
 namespace RakNet {
 	class RakPeerInterface;
@@ -26,14 +36,75 @@ public:
 
 private:
 
-	RakNet::RakPeerInterface*	m_peerInterface;
+	// the entities as the network thread last reconciled them, and when on the local raknet clock
+	struct WorldState
+	{
+		RakNet::TimeUS			sampledAt;
+		std::vector<AIEntity>	entities;
+	};
+
+	// receives, decodes, buffers and reconciles on its own thread so packet bursts never cost the render thread a frame
+	// handlePacket returns true if it buffered entities
+	void	networkLoop();
+	bool	handlePacket(RakNet::Packet* packet);
+
+	// tells the server where the camera is looking so it can favour nearby entities
+	// the render thread works out the point each frame, the network thread sends it
+	void	updateView();
+	void	sendView();
+
+	// prints how entity lists have been arriving, to compare against the server's -loss and -delay
+	void	printReceiveStats();
+
+	// render thread
 
 	Camera*						m_camera;
+	EntityRenderer*				m_entityRenderer;
+
+	// frame times between prints, to compare against the packets received meanwhile
+	FrameTimeHistogram			m_frameTimes;
+	GLfloat						m_statsTimer;
+	const GLfloat				STATS_INTERVAL = 5.0f;
+
+	// shared between the threads
+
+	std::thread					m_networkThread;
+	std::atomic<bool>			m_running;
+
+	// the network thread publishes each reconciled state here, the render thread takes the newest with one atomic swap
+	TripleBuffer<WorldState>	m_world;
+
+	// where the camera is looking on the ground, written by the render thread and sent on by the network thread
+	std::atomic<float>			m_viewX;
+	std::atomic<float>			m_viewY;
+
+	// entity list packets received, read and reset by the render thread alongside its frame times
+	std::atomic<unsigned int>	m_packetsReceived;
+
+	// network thread, once startup has started it
+
+	RakNet::RakPeerInterface*	m_peerInterface;
+	RakNet::SystemAddress		m_serverAddress;
+	bool						m_connected;
+	const RakNet::TimeUS		VIEW_INTERVAL = 100000;
+	const RakNet::TimeUS		RECEIVE_STATS_INTERVAL = 5000000;
+
+	// checks for packets this often, the renderer advances what it draws by its age so motion is not stepped
+	const unsigned int			NETWORK_SLEEP_MILLISECONDS = 1;
+
+	// reassembles entity list chunks and keeps recent snapshots, the server sends deltas against the ones we acknowledge
+	SnapshotReceiver			m_snapshotReceiver;
+
+	// decoded snapshots by server time, entities are drawn interpolated a little behind the newest
+	SnapshotJitterBuffer		m_jitterBuffer;
+
+	// estimates the server's clock, snapshots are placed and entities extrapolated by their age on it
+	ClockSync					m_clockSync;
 
-	std::vector<AIEntity>		m_aiEntities;
-	std::vector<AIEntity>		m_aiPrevEntities; // way to store our entities from the previous frame.
+	// the jitter buffer's authoritative state each pass, what is published blends onto it when it changes course
+	std::vector<AIEntity>		m_targetEntities;
+	EntityReconciler			m_reconciler;
 
-	// Used for timestamping
-	RakNet::Time m_uiPrevTimeStamp;
+	// Used for timestamping, the timestamp of the last entity list received
 	RakNet::Time m_uiCurrentTimeStamp;
 };
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "ClockSync.h"
+#include "AIEntity.h"
+
+ClockSync::ClockSync() {
+	clear();
+}
+
+void ClockSync::clear() {
+	m_samples = 0;
+	m_next = 0;
+	m_offset = 0;
+	m_roundTrip = 0;
+	m_hasRequest = false;
+	m_lastRequest = 0;
+}
+
+bool ClockSync::requestDue(RakNet::TimeUS now) const {
+	if (!m_hasRequest)
+		return true;
+	RakNet::TimeUS interval = m_samples < FILTER_SAMPLES ? BURST_INTERVAL : SYNC_INTERVAL;
+	return now - m_lastRequest >= interval;
+}
+
+void ClockSync::writeRequest(RakNet::BitStream& stream, RakNet::TimeUS now) {
+	stream.Write((RakNet::MessageID)ID_CLOCK_SYNC);
+	stream.Write(now);
+	m_hasRequest = true;
+	m_lastRequest = now;
+}
+
+bool ClockSync::writeReply(const unsigned char* data, unsigned int length, RakNet::TimeUS receiveTime, RakNet::TimeUS sendTime, RakNet::BitStream& reply) {
+
+	RakNet::BitStream stream((unsigned char*)data, length, false);
+	stream.IgnoreBytes(sizeof(RakNet::MessageID));
+	RakNet::TimeUS requestTime;
+	if (!stream.Read(requestTime))
+		return false;
+
+	reply.Write((RakNet::MessageID)ID_CLOCK_SYNC);
+	reply.Write(requestTime);
+	reply.Write(receiveTime);
+	reply.Write(sendTime);
+	return true;
+}
+
+bool ClockSync::readReply(const unsigned char* data, unsigned int length, RakNet::TimeUS now) {
+
+	RakNet::BitStream stream((unsigned char*)data, length, false);
+	stream.IgnoreBytes(sizeof(RakNet::MessageID));
+	RakNet::TimeUS requestTime, receiveTime, sendTime;
+	if (!stream.Read(requestTime) || !stream.Read(receiveTime) || !stream.Read(sendTime))
+		return false;
+	if (requestTime > now || !m_hasRequest || requestTime > m_lastRequest)
+		return false;
+
+	// t0 request sent, t1 server received, t2 server replied, t3 reply received
+	double t0 = requestTime / 1000.0, t1 = receiveTime / 1000.0, t2 = sendTime / 1000.0, t3 = now / 1000.0;
+	Sample sample;
+	sample.offset = ((t1 - t0) + (t2 - t3)) / 2;
+	sample.roundTrip = (t3 - t0) - (t2 - t1);
+	if (sample.roundTrip < 0)
+		sample.roundTrip = 0;
+
+	m_filter[m_next] = sample;
+	m_next = (m_next + 1) % FILTER_SAMPLES;
+	bool first = m_samples == 0;
+	if (m_samples < FILTER_SAMPLES)
+		++m_samples;
+
+	const Sample* best = &m_filter[0];
+	for (unsigned int i = 1; i < m_samples; ++i) {
+		if (m_filter[i].roundTrip < best->roundTrip)
+			best = &m_filter[i];
+	}
+
+	m_roundTrip = best->roundTrip;
+	if (first)
+		m_offset = best->offset;
+	else
+		m_offset += (best->offset - m_offset) * OFFSET_GAIN;
+	return true;
+}
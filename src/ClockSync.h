@@ -0,0 +1,59 @@
+#pragma once
+#include <BitStream.h>
+#include <RakNetTime.h>
+
+// estimates the server's clock from NTP style exchanges of ID_CLOCK_SYNC
+// each exchange gives an offset and a round trip, the offset is taken from the exchange with the shortest
+// round trip of the last few, as its delays were the least able to be lopsided, and eased in so it never jumps
+// times are microseconds on each side's raknet clock, the estimates are in milliseconds
+class ClockSync {
+public:
+
+	ClockSync();
+
+	void	clear();
+
+	// a request is due at startup, every BURST_INTERVAL until the filter is full, then every SYNC_INTERVAL
+	bool	requestDue(RakNet::TimeUS now) const;
+	void	writeRequest(RakNet::BitStream& stream, RakNet::TimeUS now);
+
+	// the server's reply, received at now, false if it is cut short or answers something we never sent
+	bool	readReply(const unsigned char* data, unsigned int length, RakNet::TimeUS now);
+
+	// server side, answers a request received at receiveTime and sent back at sendTime
+	static bool	writeReply(const unsigned char* data, unsigned int length, RakNet::TimeUS receiveTime, RakNet::TimeUS sendTime, RakNet::BitStream& reply);
+
+	bool	synchronised() const	{ return m_samples > 0; }
+
+	// server clock minus local clock, and the best recent round trip
+	double	offset() const			{ return m_offset; }
+	double	roundTrip() const		{ return m_roundTrip; }
+
+	// the server's clock now, in milliseconds
+	double	serverTime(RakNet::TimeUS localNow) const	{ return localNow / 1000.0 + m_offset; }
+
+	static const unsigned int	FILTER_SAMPLES = 8;
+
+private:
+
+	struct Sample {
+		double	offset;
+		double	roundTrip;
+	};
+
+	Sample			m_filter[FILTER_SAMPLES];
+	unsigned int	m_samples;
+	unsigned int	m_next;
+
+	double			m_offset;
+	double			m_roundTrip;
+
+	bool			m_hasRequest;
+	RakNet::TimeUS	m_lastRequest;
+
+	const RakNet::TimeUS	BURST_INTERVAL = 100000;
+	const RakNet::TimeUS	SYNC_INTERVAL = 2000000;
+
+	// how much of the difference to the newly filtered offset is taken on each exchange
+	const double	OFFSET_GAIN = 0.25;
+};
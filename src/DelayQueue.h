@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// items waiting until an absolute deadline, kept in a binary min-heap
+// push and pop are O(log n), checking for expired items is O(1) and nothing is touched while it waits
+// items with equal deadlines come out in the order they were pushed
+template <typename T>
+class DelayQueue {
+public:
+
+	DelayQueue() : m_pushed(0) {}
+
+	bool			empty() const { return m_heap.empty(); }
+	unsigned int	size() const { return (unsigned int)m_heap.size(); }
+
+	// only valid when not empty
+	uint64_t		nextDeadline() const { return m_heap.front().deadline; }
+
+	void	push(uint64_t deadline, const T& item) {
+		Entry entry = { deadline, m_pushed++, item };
+		m_heap.push_back(entry);
+		std::push_heap(m_heap.begin(), m_heap.end(), later);
+	}
+
+	// takes the earliest item if its deadline is at or before now
+	bool	popExpired(uint64_t now, T& item) {
+		if (m_heap.empty() || m_heap.front().deadline > now)
+			return false;
+		std::pop_heap(m_heap.begin(), m_heap.end(), later);
+		item = m_heap.back().item;
+		m_heap.pop_back();
+		return true;
+	}
+
+	// takes the earliest item regardless of its deadline
+	bool	pop(T& item) {
+		return popExpired(UINT64_MAX, item);
+	}
+
+private:
+
+	struct Entry {
+		uint64_t	deadline;
+		uint64_t	order;
+		T			item;
+	};
+
+	// std heaps are max-heaps, so order by which comes out later
+	static bool	later(const Entry& a, const Entry& b) {
+		return a.deadline != b.deadline ? a.deadline > b.deadline : a.order > b.order;
+	}
+
+	std::vector<Entry>	m_heap;
+	uint64_t			m_pushed;
+};
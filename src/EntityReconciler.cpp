@@ -0,0 +1,158 @@
+#include "EntityReconciler.h"
+#include <cstring>
+
+void reconcileSnap(const ReconcileStart&, const AIEntity& target, float, float, AIEntity& out) {
+	out = target;
+}
+
+void reconcileProjectiveVelocity(const ReconcileStart& start, const AIEntity& target, float elapsed, float blendTime, AIEntity& out) {
+
+	float t = blendTime > 0 ? elapsed / blendTime : 1;
+
+	// the old motion carried on with a velocity that turns toward the new one
+	AIVector velocity;
+	velocity.x = start.velocity.x + (target.velocity.x - start.velocity.x) * t;
+	velocity.y = start.velocity.y + (target.velocity.y - start.velocity.y) * t;
+
+	AIVector projected;
+	projected.x = start.position.x + velocity.x * elapsed;
+	projected.y = start.position.y + velocity.y * elapsed;
+
+	out = target;
+	out.position.x = projected.x + (target.position.x - projected.x) * t;
+	out.position.y = projected.y + (target.position.y - projected.y) * t;
+	out.velocity = velocity;
+}
+
+void reconcileHermite(const ReconcileStart& start, const AIEntity& target, float elapsed, float blendTime, AIEntity& out) {
+
+	if (blendTime <= 0) {
+		out = target;
+		return;
+	}
+
+	// the new trajectory carried on to the end of the blend is where the curve has to arrive
+	float remaining = blendTime - elapsed;
+	AIVector end;
+	end.x = target.position.x + target.velocity.x * remaining;
+	end.y = target.position.y + target.velocity.y * remaining;
+
+	float s = elapsed / blendTime;
+	float s2 = s * s, s3 = s2 * s;
+	float h00 = 2 * s3 - 3 * s2 + 1;
+	float h10 = (s3 - 2 * s2 + s) * blendTime;
+	float h01 = -2 * s3 + 3 * s2;
+	float h11 = (s3 - s2) * blendTime;
+
+	// derivatives over s, divided through by blendTime for velocity
+	float d00 = (6 * s2 - 6 * s) / blendTime;
+	float d10 = 3 * s2 - 4 * s + 1;
+	float d01 = (-6 * s2 + 6 * s) / blendTime;
+	float d11 = 3 * s2 - 2 * s;
+
+	out = target;
+	out.position.x = h00 * start.position.x + h10 * start.velocity.x + h01 * end.x + h11 * target.velocity.x;
+	out.position.y = h00 * start.position.y + h10 * start.velocity.y + h01 * end.y + h11 * target.velocity.y;
+	out.velocity.x = d00 * start.position.x + d10 * start.velocity.x + d01 * end.x + d11 * target.velocity.x;
+	out.velocity.y = d00 * start.position.y + d10 * start.velocity.y + d01 * end.y + d11 * target.velocity.y;
+}
+
+ReconcileBlend selectReconcileBlend(const char* preferred, const char** selectedName) {
+
+	ReconcileBlend blend = reconcileProjectiveVelocity;
+	const char* name = "projective";
+
+	if (preferred != nullptr) {
+		if (strcmp(preferred, "snap") == 0) {
+			blend = reconcileSnap;
+			name = "snap";
+		}
+		else if (strcmp(preferred, "hermite") == 0) {
+			blend = reconcileHermite;
+			name = "hermite";
+		}
+	}
+
+	if (selectedName != nullptr)
+		*selectedName = name;
+	return blend;
+}
+
+EntityReconciler::EntityReconciler(const ReconcileSettings& settings)
+	: m_settings(settings) {
+	clear();
+}
+
+void EntityReconciler::clear() {
+	m_states.clear();
+	m_blends = 0;
+	m_snaps = 0;
+	m_teleports = 0;
+}
+
+void EntityReconciler::update(const std::vector<AIEntity>& target, float deltaTime, std::vector<AIEntity>& displayed) {
+
+	if (m_states.size() != target.size()) {
+		EntityState invalid;
+		memset(&invalid, 0, sizeof(invalid));
+		m_states.resize(target.size(), invalid);
+	}
+	displayed.resize(target.size());
+
+	float threshold = m_settings.correctionThreshold * m_settings.correctionThreshold;
+	float snap = m_settings.snapDistance * m_settings.snapDistance;
+
+	for (unsigned int i = 0; i < target.size(); ++i) {
+		const AIEntity& t = target[i];
+		AIEntity& d = displayed[i];
+		EntityState& state = m_states[i];
+
+		// where last frame's target was heading, anything else means new information arrived
+		float expectedX = state.lastPosition.x + state.lastVelocity.x * deltaTime;
+		float expectedY = state.lastPosition.y + state.lastVelocity.y * deltaTime;
+		float changeX = t.position.x - expectedX;
+		float changeY = t.position.y - expectedY;
+		bool changed = changeX * changeX + changeY * changeY > threshold;
+
+		bool first = !state.valid;
+		state.valid = true;
+		state.lastPosition = t.position;
+		state.lastVelocity = t.velocity;
+
+		// a teleport is a jump on the server too, there is nothing to blend across
+		if (first || t.teleported) {
+			if (t.teleported)
+				++m_teleports;
+			state.blending = false;
+		}
+		else if (changed) {
+			float errorX = state.shownPosition.x - t.position.x;
+			float errorY = state.shownPosition.y - t.position.y;
+			if (snap > 0 && errorX * errorX + errorY * errorY > snap) {
+				++m_snaps;
+				state.blending = false;
+			}
+			else {
+				// from whatever was on screen, even if that was part way through another blend
+				++m_blends;
+				state.blending = true;
+				state.blendElapsed = 0;
+				state.start.position = state.shownPosition;
+				state.start.velocity = state.shownVelocity;
+			}
+		}
+
+		if (state.blending) {
+			state.blendElapsed += deltaTime;
+			if (state.blendElapsed < m_settings.blendTime)
+				m_settings.blend(state.start, t, state.blendElapsed, m_settings.blendTime, d);
+			else
+				state.blending = false;
+		}
+		if (!state.blending)
+			d = t;
+
+		state.shownPosition = d.position;
+		state.shownVelocity = d.velocity;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+
+#include "../src/AIEntity.h"
+
+// where a blend started from, the position and velocity being displayed when the authoritative trajectory changed
+struct ReconcileStart
+{
+	AIVector	position;
+	AIVector	velocity;
+};
+
+// moves out from start onto target's trajectory, elapsed seconds into a blend lasting blendTime
+// target is the authoritative state now, out is what is displayed
+typedef void(*ReconcileBlend)(const ReconcileStart& start, const AIEntity& target, float elapsed, float blendTime, AIEntity& out);
+
+// jumps straight onto the new trajectory
+void	reconcileSnap(const ReconcileStart& start, const AIEntity& target, float elapsed, float blendTime, AIEntity& out);
+
+// projective velocity blending, the old motion is projected with a velocity blended toward the new one,
+// then the position is blended from that projection to the new trajectory
+void	reconcileProjectiveVelocity(const ReconcileStart& start, const AIEntity& target, float elapsed, float blendTime, AIEntity& out);
+
+// cubic Hermite curve from the old position and velocity to where the new trajectory will be when the blend ends
+void	reconcileHermite(const ReconcileStart& start, const AIEntity& target, float elapsed, float blendTime, AIEntity& out);
+
+// returns the blend called preferred ("snap", "projective", "hermite"), projective if it is null or unknown
+ReconcileBlend	selectReconcileBlend(const char* preferred, const char** selectedName);
+
+struct ReconcileSettings
+{
+	ReconcileBlend	blend;
+
+	// seconds to settle onto a new trajectory
+	float			blendTime;
+
+	// errors bigger than this snap rather than blend, 0 always blends
+	float			snapDistance;
+
+	// a change in the authoritative trajectory smaller than this is followed directly, interpolation alone wobbles this much
+	float			correctionThreshold;
+
+	ReconcileSettings()
+		: blend(reconcileProjectiveVelocity), blendTime(0.1f), snapDistance(5), correctionThreshold(0.05f) {}
+};
+
+// smooths the jumps in the jitter buffer's output when new snapshots correct an extrapolation
+// teleports skip straight to the new position, anything else that changes the trajectory starts a blend
+class EntityReconciler {
+public:
+
+	explicit EntityReconciler(const ReconcileSettings& settings = ReconcileSettings());
+
+	void	clear();
+
+	const ReconcileSettings&	settings() const	{ return m_settings; }
+	void	setSettings(const ReconcileSettings& settings)	{ m_settings = settings; }
+
+	// target is this frame's authoritative state, displayed is overwritten with what to show
+	// it need not hold last frame's output, what was shown is kept here to blend from
+	void	update(const std::vector<AIEntity>& target, float deltaTime, std::vector<AIEntity>& displayed);
+
+	// corrections since clear()
+	unsigned int	blends() const		{ return m_blends; }
+	unsigned int	snaps() const		{ return m_snaps; }
+	unsigned int	teleports() const	{ return m_teleports; }
+
+private:
+
+	struct EntityState {
+		bool			valid;
+
+		// last frame's target, where it was heading tells us whether this frame's has changed course
+		AIVector		lastPosition;
+		AIVector		lastVelocity;
+
+		// what was shown last frame
+		AIVector		shownPosition;
+		AIVector		shownVelocity;
+
+		bool			blending;
+		float			blendElapsed;
+		ReconcileStart	start;
+	};
+
+	ReconcileSettings			m_settings;
+	std::vector<EntityState>	m_states;
+
+	unsigned int				m_blends;
+	unsigned int				m_snaps;
+	unsigned int				m_teleports;
+};
@@ -0,0 +1,143 @@
+#include "EntityRenderer.h"
+#include "gl_core_4_4.h"
+#include <cstdio>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+// the same arrow draw() used to add through Gizmos::addTri, a tip a quarter of a second ahead
+// and two corners either side of the position, a tenth of the velocity out to each side
+// colour 1 is the entity with id 1, drawn pink, the rest are red
+static const char* vsSource = "#version 150\n \
+					 in vec2 Position; \
+					 in vec2 Velocity; \
+					 in uint ColourId; \
+					 out vec4 vColour; \
+					 uniform mat4 ProjectionView; \
+					 const vec2 corners[3] = vec2[3](vec2(0.25, 0), vec2(0, -0.1), vec2(0, 0.1)); \
+					 const vec4 colours[2] = vec4[2](vec4(1, 0, 0, 1), vec4(1, 0, 1, 1)); \
+					 void main() { \
+						vec2 side = vec2(-Velocity.y, Velocity.x); \
+						vec2 corner = Position + Velocity * corners[gl_VertexID].x + side * corners[gl_VertexID].y; \
+						vColour = colours[min(ColourId, 1u)]; \
+						gl_Position = ProjectionView * vec4(corner.x, 0, corner.y, 1); }";
+
+static const char* fsSource = "#version 150\n \
+					 in vec4 vColour; \
+					 out vec4 FragColor; \
+					 void main()	{ FragColor = vColour; }";
+
+// truncating float to half conversion, tiny values flush to zero and huge ones clamp to the largest half
+// plenty for an arrow's direction and length, and a few times quicker than glm::packHalf2x16
+static inline uint32_t toHalf(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	if (exponent <= 0)
+		return sign;
+	if (exponent >= 31)
+		return sign | 0x7bff;
+	return sign | ((uint32_t)exponent << 10) | ((bits >> 13) & 0x3ff);
+}
+
+EntityRenderer::EntityRenderer()
+	: m_capacity(0) {
+
+	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
+	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
+
+	glShaderSource(vs, 1, (const char**)&vsSource, 0);
+	glCompileShader(vs);
+
+	glShaderSource(fs, 1, (const char**)&fsSource, 0);
+	glCompileShader(fs);
+
+	m_shader = glCreateProgram();
+	glAttachShader(m_shader, vs);
+	glAttachShader(m_shader, fs);
+	glBindAttribLocation(m_shader, 0, "Position");
+	glBindAttribLocation(m_shader, 1, "Velocity");
+	glBindAttribLocation(m_shader, 2, "ColourId");
+	glLinkProgram(m_shader);
+
+	int success = GL_FALSE;
+	glGetProgramiv(m_shader, GL_LINK_STATUS, &success);
+	if (success == GL_FALSE) {
+		int infoLogLength = 0;
+		glGetProgramiv(m_shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+		char* infoLog = new char[infoLogLength + 1];
+		infoLog[0] = 0;
+
+		glGetProgramInfoLog(m_shader, infoLogLength + 1, 0, infoLog);
+		printf("Error: Failed to link entity shader program!\n%s\n", infoLog);
+		delete[] infoLog;
+	}
+
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	m_projectionViewUniform = glGetUniformLocation(m_shader, "ProjectionView");
+
+	glGenBuffers(1, &m_vbo);
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+	// one record per instance, every vertex of an arrow reads the same one
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(EntityInstance), 0);
+	glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(EntityInstance), ((char*)0) + 8);
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(EntityInstance), ((char*)0) + 12);
+	glVertexAttribDivisor(0, 1);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribDivisor(2, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+EntityRenderer::~EntityRenderer() {
+	glDeleteBuffers(1, &m_vbo);
+	glDeleteVertexArrays(1, &m_vao);
+	glDeleteProgram(m_shader);
+}
+
+void EntityRenderer::draw(const std::vector<AIEntity>& entities, float age, const glm::mat4& projectionView) {
+
+	m_instances.resize(entities.size());
+	if (entities.empty())
+		return;
+
+	for (size_t i = 0; i < entities.size(); ++i) {
+		const AIEntity& ai = entities[i];
+		EntityInstance& instance = m_instances[i];
+		instance.x = ai.position.x + ai.velocity.x * age;
+		instance.y = ai.position.y + ai.velocity.y * age;
+		instance.velocity = toHalf(ai.velocity.x) | (toHalf(ai.velocity.y) << 16);
+		instance.colour = ai.id == 1 ? 1 : 0;
+	}
+
+	unsigned int count = (unsigned int)m_instances.size();
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	if (count > m_capacity)
+		m_capacity = count;
+
+	// orphan last frame's data rather than wait for the GPU to finish drawing from it
+	glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(EntityInstance), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(EntityInstance), m_instances.data());
+
+	int shader = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &shader);
+
+	glUseProgram(m_shader);
+	glUniformMatrix4fv(m_projectionViewUniform, 1, false, glm::value_ptr(projectionView));
+
+	glBindVertexArray(m_vao);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 3, count);
+	glBindVertexArray(0);
+
+	glUseProgram(shader);
+}
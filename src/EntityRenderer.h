@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include <glm/fwd.hpp>
+
+#include "AIEntity.h"
+
+// draws every entity as an arrow in one instanced draw call
+// each entity uploads one 16 byte record, the shader builds the arrow's three corners from it,
+// where Gizmos::addTri takes three 32 byte vertices worked out on the CPU
+// needs a current GL context to create and destroy
+class EntityRenderer {
+public:
+
+	EntityRenderer();
+	~EntityRenderer();
+
+	// each entity is drawn age seconds further along its velocity
+	void	draw(const std::vector<AIEntity>& entities, float age, const glm::mat4& projectionView);
+
+	// bytes of instance data uploaded by the last draw
+	size_t	uploadedBytes() const	{ return m_instances.size() * sizeof(EntityInstance); }
+
+private:
+
+	// position as floats, velocity as two half floats as it only sets the arrow's direction and length,
+	// and which colour to draw in
+	struct EntityInstance {
+		float		x, y;
+		uint32_t	velocity;
+		uint32_t	colour;
+	};
+
+	unsigned int	m_shader;
+	int				m_projectionViewUniform;
+
+	// instance attributes only, the corners come from gl_VertexID
+	unsigned int	m_vao;
+	unsigned int	m_vbo;
+
+	// entities the buffer has room for, it grows to the most drawn and never shrinks
+	unsigned int	m_capacity;
+
+	std::vector<EntityInstance>	m_instances;
+};
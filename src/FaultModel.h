@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+
+#include "../src/Random.h"
+
+// the simulated bad network, loses packets every so often and holds back some of the rest
+// draws from its own random stream so changing the rates never changes entity trajectories,
+// and the same seed gives the same losses and delays whatever carries the packets
+class FaultModel {
+public:
+
+	FaultModel(float packetlossPercentage = 0, float delayPercentage = 0, float delayRange = 0, uint64_t seed = 1)
+		: m_packetlossPercentage(packetlossPercentage),
+		m_delayPercentage(delayPercentage),
+		m_delayRange(delayRange),
+		m_random(seed, RANDOM_STREAM_FAULTS) {}
+
+	// false if the packet is lost, otherwise how long to hold it back in microseconds, 0 sends it now
+	bool	apply(uint64_t& delayMicroseconds) {
+		delayMicroseconds = 0;
+
+		// lose messages every so often
+		if (m_random.randf() * 100 < m_packetlossPercentage)
+			return false;
+
+		// delay messages every so often, by up to the delay range in seconds
+		if (m_random.randf() * 100 < m_delayPercentage)
+			delayMicroseconds = (uint64_t)(m_random.randf() * m_delayRange * 1000.0 * 1000.0);
+		return true;
+	}
+
+private:
+
+	float	m_packetlossPercentage;
+	float	m_delayPercentage;
+	float	m_delayRange;
+	Random	m_random;
+};
@@ -0,0 +1,67 @@
+#include "FrameTimeHistogram.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+void FrameTimeHistogram::reset() {
+	m_count = 0;
+	m_sum = 0;
+	m_sumSquares = 0;
+	m_worst = 0;
+	memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+void FrameTimeHistogram::record(double seconds) {
+	double milliseconds = seconds * 1000;
+	++m_count;
+	m_sum += milliseconds;
+	m_sumSquares += milliseconds * milliseconds;
+	m_worst = std::max(m_worst, milliseconds);
+
+	unsigned int bucket = milliseconds > 0 ? (unsigned int)std::min(milliseconds * BUCKETS_PER_MILLISECOND, (double)BUCKET_COUNT - 1) : 0;
+	++m_buckets[bucket];
+}
+
+double FrameTimeHistogram::percentile(double fraction) const {
+	unsigned int target = (unsigned int)std::ceil(m_count * fraction);
+	unsigned int seen = 0;
+	for (unsigned int i = 0; i < BUCKET_COUNT; ++i) {
+		seen += m_buckets[i];
+		if (seen >= target)
+			return (double)(i + 1) / BUCKETS_PER_MILLISECOND;
+	}
+	return (double)BUCKET_COUNT / BUCKETS_PER_MILLISECOND;
+}
+
+void FrameTimeHistogram::print(std::ostream& out) const {
+	if (m_count == 0)
+		return;
+
+	double mean = m_sum / m_count;
+	double deviation = sqrt(std::max(0.0, m_sumSquares / m_count - mean * mean));
+
+	out << "Frame time over " << m_count << " frames in ms - mean: " << mean << ", deviation: " << deviation
+		<< ", median: <" << percentile(0.5) << ", 99th percentile: <" << percentile(0.99) << ", worst: " << m_worst << std::endl;
+
+	// coarse ranges ending just past the 144, 120, 90, 60 and 30Hz refresh intervals,
+	// a hitch shows up as frames past the range the rest are in
+	const double edges[] = { 2, 4, 7, 8.4, 11.2, 16.8, 33.4, 50 };
+	const unsigned int edgeCount = sizeof(edges) / sizeof(edges[0]);
+	unsigned int bucket = 0;
+	double from = 0;
+	for (unsigned int e = 0; e <= edgeCount; ++e) {
+		unsigned int end = e < edgeCount ? (unsigned int)(edges[e] * BUCKETS_PER_MILLISECOND + 0.5) : BUCKET_COUNT;
+		unsigned int frames = 0;
+		for (; bucket < end; ++bucket)
+			frames += m_buckets[bucket];
+
+		if (frames > 0) {
+			out << "  " << from << (e < edgeCount ? " - " : "+");
+			if (e < edgeCount)
+				out << edges[e];
+			out << " ms: " << frames << " (" << 100.0 * frames / m_count << "%)" << std::endl;
+		}
+		if (e < edgeCount)
+			from = edges[e];
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <ostream>
+
+// how long each client frame took, to show whether packet bursts reach the render thread
+class FrameTimeHistogram {
+public:
+
+	FrameTimeHistogram() { reset(); }
+
+	void	reset();
+	void	record(double seconds);
+
+	unsigned int	count() const { return m_count; }
+
+	// mean, deviation, median, 99th percentile and worst frame in milliseconds, then frames per range
+	void	print(std::ostream& out) const;
+
+private:
+
+	// upper edge of the bucket the given fraction of frames falls in
+	double	percentile(double fraction) const;
+
+	// 0.1ms buckets up to 100ms, anything slower lands in the last one
+	static const unsigned int	BUCKETS_PER_MILLISECOND = 10;
+	static const unsigned int	BUCKET_COUNT = 1000;
+
+	unsigned int	m_count;
+	double			m_sum;
+	double			m_sumSquares;
+	double			m_worst;
+	unsigned int	m_buckets[BUCKET_COUNT];
+};
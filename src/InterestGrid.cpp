@@ -0,0 +1,67 @@
+#include "InterestGrid.h"
+#include <algorithm>
+#include <cmath>
+
+InterestGrid::InterestGrid()
+	: m_origin(0),
+	m_inverseCellSize(1),
+	m_cellsPerSide(1) {
+}
+
+void InterestGrid::init(float radius, float cellSize) {
+	m_origin = -radius;
+	m_inverseCellSize = 1 / cellSize;
+	m_cellsPerSide = std::max(1u, (unsigned int)ceilf(radius * 2 / cellSize));
+	m_cellStart.assign(m_cellsPerSide * m_cellsPerSide + 1, 0);
+	m_cellCursor.assign(m_cellsPerSide * m_cellsPerSide, 0);
+}
+
+unsigned int InterestGrid::cellCoordinate(float value) const {
+	float cell = (value - m_origin) * m_inverseCellSize;
+	if (!(cell > 0))
+		return 0;
+	return std::min((unsigned int)cell, m_cellsPerSide - 1);
+}
+
+void InterestGrid::build(const float* positionsX, const float* positionsY, unsigned int count) {
+
+	// resize only allocates the first time or when the entity count grows
+	m_entityCell.resize(count);
+	m_cellEntities.resize(count);
+
+	// count each cell's entities, then turn the counts into where each cell starts
+	std::fill(m_cellStart.begin(), m_cellStart.end(), 0);
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned int cell = cellCoordinate(positionsY[i]) * m_cellsPerSide + cellCoordinate(positionsX[i]);
+		m_entityCell[i] = cell;
+		++m_cellStart[cell + 1];
+	}
+	unsigned int cells = m_cellsPerSide * m_cellsPerSide;
+	for (unsigned int c = 0; c < cells; ++c)
+		m_cellStart[c + 1] += m_cellStart[c];
+
+	// each cell's entities stay in id order
+	std::copy(m_cellStart.begin(), m_cellStart.end() - 1, m_cellCursor.begin());
+	for (unsigned int i = 0; i < count; ++i)
+		m_cellEntities[m_cellCursor[m_entityCell[i]]++] = i;
+}
+
+void InterestGrid::markWithin(float x, float y, float radius, const float* positionsX, const float* positionsY, unsigned char* relevant) const {
+
+	unsigned int minX = cellCoordinate(x - radius), maxX = cellCoordinate(x + radius);
+	unsigned int minY = cellCoordinate(y - radius), maxY = cellCoordinate(y + radius);
+	float radiusSquared = radius * radius;
+
+	for (unsigned int cellY = minY; cellY <= maxY; ++cellY) {
+		for (unsigned int cellX = minX; cellX <= maxX; ++cellX) {
+			unsigned int cell = cellY * m_cellsPerSide + cellX;
+			for (unsigned int k = m_cellStart[cell]; k < m_cellStart[cell + 1]; ++k) {
+				unsigned int id = m_cellEntities[k];
+				float dx = positionsX[id] - x;
+				float dy = positionsY[id] - y;
+				if (dx * dx + dy * dy <= radiusSquared)
+					relevant[id] = 1;
+			}
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+
+// uniform grid over the arena for finding the entities near a point
+// rebuilt from scratch every tick with a counting sort into arrays that are only ever reused,
+// so once they have grown to the entity count neither building nor querying allocates
+class InterestGrid {
+public:
+
+	InterestGrid();
+
+	// square cells of cellSize covering [-radius, radius] on both axes
+	void	init(float radius, float cellSize);
+
+	// positions outside the area go into the nearest edge cell
+	void	build(const float* positionsX, const float* positionsY, unsigned int count);
+
+	// sets relevant to 1 for every entity within radius of (x, y), the positions must be the ones it was built from
+	void	markWithin(float x, float y, float radius, const float* positionsX, const float* positionsY, unsigned char* relevant) const;
+
+private:
+
+	unsigned int	cellCoordinate(float value) const;
+
+	float			m_origin;
+	float			m_inverseCellSize;
+	unsigned int	m_cellsPerSide;
+
+	// entities sorted by cell, cell c's are [m_cellStart[c], m_cellStart[c + 1])
+	std::vector<unsigned int>	m_cellStart;
+	std::vector<unsigned int>	m_cellEntities;
+
+	// scratch for the sort, each entity's cell and where the next one of each cell goes
+	std::vector<unsigned int>	m_entityCell;
+	std::vector<unsigned int>	m_cellCursor;
+};
@@ -0,0 +1,71 @@
+#include "LoopbackTransport.h"
+
+LoopbackTransport::LoopbackTransport(unsigned int clientCount, uint64_t latencyMicroseconds, const FaultModel& upstreamFaults)
+	: m_now(0),
+	m_latency(latencyMicroseconds),
+	m_upstreamFaults(upstreamFaults),
+	m_toClients(clientCount),
+	m_packetsToClients(0),
+	m_bytesToClients(0),
+	m_packetsToServer(0),
+	m_upstreamLost(0)
+{
+	// never sent anywhere, only told apart by port, the index finds the client's queue without a search
+	m_addresses.resize(clientCount);
+	for (unsigned int i = 0; i < clientCount; ++i) {
+		m_addresses[i] = RakNet::SystemAddress("127.0.0.1", (unsigned short)(i + 1));
+		m_addresses[i].systemIndex = (RakNet::SystemIndex)i;
+	}
+}
+
+LoopbackTransport::~LoopbackTransport() {
+
+	// give back whatever never arrived
+	SharedPayload* payload;
+	for (auto& queue : m_toClients) {
+		while (queue.pop(payload))
+			payload->release();
+	}
+
+	Packet packet;
+	while (m_toServer.pop(packet))
+		packet.payload->release();
+}
+
+bool LoopbackTransport::sendToClient(SharedPayload* payload, const RakNet::SystemAddress& address) {
+
+	unsigned int client = address.systemIndex;
+	if (client >= m_addresses.size() || m_addresses[client] != address)
+		return false;
+
+	payload->addReference();
+	m_toClients[client].push(m_now + m_latency, payload);
+	++m_packetsToClients;
+	m_bytesToClients += payload->stream.GetNumberOfBytesUsed();
+	return true;
+}
+
+bool LoopbackTransport::receiveFromClient(Packet& packet) {
+	return m_toServer.popExpired(m_now, packet);
+}
+
+void LoopbackTransport::sendToServer(unsigned int client, const RakNet::BitStream& stream) {
+
+	++m_packetsToServer;
+	uint64_t delay;
+	if (!m_upstreamFaults.apply(delay)) {
+		++m_upstreamLost;
+		return;
+	}
+
+	Packet packet;
+	packet.client = client;
+	packet.payload = m_pool.acquire();
+	packet.payload->stream.WriteAlignedBytes(stream.GetData(), (unsigned int)stream.GetNumberOfBytesUsed());
+	m_toServer.push(m_now + m_latency + delay, packet);
+}
+
+bool LoopbackTransport::receiveFromServer(unsigned int client, Packet& packet) {
+	packet.client = client;
+	return m_toClients[client].popExpired(m_now, packet.payload);
+}
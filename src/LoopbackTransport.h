@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include <RakNetTypes.h>
+#include <BitStream.h>
+
+#include "../src/SharedPayload.h"
+#include "../src/DelayQueue.h"
+#include "../src/FaultModel.h"
+
+// an in-memory network between a server and clients in the same process, standing in for raknet in benchmarks
+// time only moves when the caller advances the virtual clock and nothing arrives before it is due,
+// so a run with the same seed repeats exactly and never touches a socket
+// packets to clients are shared payloads, referenced rather than copied, until the client has read them
+class LoopbackTransport {
+public:
+
+	// one received packet, hand it back with release() once read
+	struct Packet {
+		unsigned int	client;
+		SharedPayload*	payload;
+
+		const unsigned char*	data() const	{ return payload->stream.GetData(); }
+		unsigned int			length() const	{ return (unsigned int)payload->stream.GetNumberOfBytesUsed(); }
+	};
+
+	// latency is added to every packet both ways
+	// the server applies its own fault model to what it sends, upstreamFaults applies to what clients send
+	LoopbackTransport(unsigned int clientCount, uint64_t latencyMicroseconds = 0, const FaultModel& upstreamFaults = FaultModel());
+	~LoopbackTransport();
+
+	// virtual clock in microseconds, starts at 0
+	uint64_t		now() const							{ return m_now; }
+	void			advance(uint64_t microseconds)		{ m_now += microseconds; }
+
+	unsigned int	clientCount() const					{ return (unsigned int)m_toClients.size(); }
+
+	// what the server knows client i by, guids start at 1
+	const RakNet::SystemAddress&	address(unsigned int client) const	{ return m_addresses[client]; }
+	uint64_t						guid(unsigned int client) const		{ return client + 1; }
+
+	// server side, takes a reference to the payload, false if the address isn't one of ours
+	bool	sendToClient(SharedPayload* payload, const RakNet::SystemAddress& address);
+	bool	receiveFromClient(Packet& packet);
+
+	// client side, the stream is copied into a pooled payload
+	void	sendToServer(unsigned int client, const RakNet::BitStream& stream);
+	bool	receiveFromServer(unsigned int client, Packet& packet);
+
+	void	release(Packet& packet)		{ packet.payload->release(); packet.payload = nullptr; }
+
+	// totals since construction
+	uint64_t	packetsToClients() const	{ return m_packetsToClients; }
+	uint64_t	bytesToClients() const		{ return m_bytesToClients; }
+	uint64_t	packetsToServer() const		{ return m_packetsToServer; }
+	uint64_t	upstreamLost() const		{ return m_upstreamLost; }
+
+private:
+
+	LoopbackTransport(const LoopbackTransport&) = delete;
+	LoopbackTransport& operator=(const LoopbackTransport&) = delete;
+
+	uint64_t							m_now;
+	uint64_t							m_latency;
+	FaultModel							m_upstreamFaults;
+
+	std::vector<RakNet::SystemAddress>	m_addresses;
+
+	// in flight, by when they arrive
+	std::vector<DelayQueue<SharedPayload*>>	m_toClients;
+	DelayQueue<Packet>						m_toServer;
+
+	// what clients send is copied in here, what the server sends comes from its own pool
+	SharedPayloadPool					m_pool;
+
+	uint64_t							m_packetsToClients;
+	uint64_t							m_bytesToClients;
+	uint64_t							m_packetsToServer;
+	uint64_t							m_upstreamLost;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+
+// Reference xoshiro128**: http://prng.di.unimi.it/
+// Reference SplitMix64: http://xorshift.di.unimi.it/splitmix64.c
+
+// independent random streams, so drawing more from one never shifts another
+enum RandomStream {
+	RANDOM_STREAM_SETUP = 1,
+	RANDOM_STREAM_SIMULATION,
+	RANDOM_STREAM_FAULTS,
+};
+
+// SplitMix64 finaliser, a cheap bijective 64 bit mix
+inline uint64_t randomMix(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// stateless counter based generator, returns random range [0,1)
+// the same seed, stream, tick and index always give the same value regardless of call order or thread
+inline float randomCounterf(uint64_t seed, RandomStream stream, uint64_t tick, uint32_t index)
+{
+	uint64_t z = randomMix(seed + 0x9E3779B97F4A7C15ull * (uint64_t)stream);
+	z = randomMix(z ^ tick);
+	z = randomMix(z ^ index);
+	return (z >> 40) * (1.0f / 16777216.0f);
+}
+
+// small sequential generator (xoshiro128**), one per stream
+class Random {
+public:
+
+	Random(uint64_t seed, RandomStream stream)
+	{
+		uint64_t z = seed + 0x9E3779B97F4A7C15ull * (uint64_t)stream;
+		uint64_t a = randomMix(z += 0x9E3779B97F4A7C15ull);
+		uint64_t b = randomMix(z += 0x9E3779B97F4A7C15ull);
+		m_state[0] = (uint32_t)a;
+		m_state[1] = (uint32_t)(a >> 32);
+		m_state[2] = (uint32_t)b;
+		m_state[3] = (uint32_t)(b >> 32);
+	}
+
+	uint32_t next()
+	{
+		uint32_t result = rotl(m_state[1] * 5, 7) * 9;
+		uint32_t t = m_state[1] << 9;
+
+		m_state[2] ^= m_state[0];
+		m_state[3] ^= m_state[1];
+		m_state[1] ^= m_state[2];
+		m_state[0] ^= m_state[3];
+		m_state[2] ^= t;
+		m_state[3] = rotl(m_state[3], 11);
+
+		return result;
+	}
+
+	// returns random range [0,1)
+	float randf()
+	{
+		return (next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+
+	static uint32_t rotl(uint32_t x, int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+
+	uint32_t m_state[4];
+};
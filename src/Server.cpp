@@ -1,41 +1,102 @@
 // Reference Raknet Timestamp: http://www.jenkinssoftware.com/raknet/manual/creatingpackets.html
 
 #include "Server.h"
+#include "AllocationCounter.h"
 #include <RakNetTypes.h>
-#include <Windows.h>
 #include <GetTime.h>
-#include <chrono>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
 
-Server::Server(unsigned int entityCount, float arenaRadius, float packetlossPercentage, float delayPercentage, float delayRange)
+Server::Server(unsigned int entityCount, float arenaRadius, float packetlossPercentage, float delayPercentage, float delayRange, float precision, unsigned int chunkBytes, uint64_t seed, unsigned int threadCount, const char* preferredKernel, float interestRadius, float bandwidthKbps, bool reportAllocations, bool reportTiming, unsigned int maxCatchUpSteps)
 	: m_arenaRadius(arenaRadius),
-	m_packetlossPercentage(packetlossPercentage),
-	m_delayPercentage(delayPercentage),
-	m_delayRange(delayRange)
+	m_seed(seed),
+	m_tick(0),
+	m_broadcastStep(true),
+	m_snapshotSequence(0),
+	m_snapshot(nullptr),
+	m_snapshotTime(0),
+	m_snapshotChunkBytes(chunkBytes),
+	m_interestRadius(interestRadius),
+	m_bandwidthKbps(bandwidthKbps),
+	m_loopback(nullptr),
+	m_faults(packetlossPercentage, delayPercentage, delayRange, seed),
+	m_running(false),
+	m_reportAllocations(reportAllocations),
+	m_tickAllocations(0),
+	m_allocationReportTick(0),
+	m_maxCatchUpSteps(maxCatchUpSteps > 0 ? maxCatchUpSteps : 1),
+	m_reportTiming(reportTiming),
+	m_sendQueuedMicroseconds(0),
+	m_delayedMicroseconds(0),
+	m_receiveMicroseconds(0)
 {
 	// initialize the Raknet peer interface first
 	m_peerInterface = RakNet::RakPeerInterface::GetInstance();
 
+	m_updateKernel = selectUpdateKernel(preferredKernel, &m_updateKernelName);
+
+	m_workers = new WorkerPool(threadCount);
+
+	m_snapshotFormat.setPrecision(m_arenaRadius, MAX_VELOCITY, precision);
+	m_snapshotEntitiesPerChunk = snapshotEntitiesPerChunk(m_snapshotFormat, entityCount, m_snapshotChunkBytes);
+
+	PayloadCacheEntry empty = { false, 0, nullptr };
+	m_payloadCache.assign(snapshotChunkCount(entityCount, m_snapshotEntitiesPerChunk) * (SNAPSHOT_HISTORY + 1), empty);
+
+	// cells the size of the interest radius so a query only touches the surrounding 3x3,
+	// capped so a tiny radius doesn't allocate a huge grid
+	if (m_interestRadius > 0) {
+		float cellSize = std::max(m_interestRadius, m_arenaRadius * 2 / 64);
+		m_interestGrid.init(m_arenaRadius, cellSize);
+	}
+
+	memset(&m_timing, 0, sizeof(m_timing));
+
 	setupAIEntities(entityCount);
 }
 
 Server::~Server() {
 
-	// delete delayed threads
-	while (m_delayedMessages.empty() == false) {
-		auto t = m_delayedMessages.back();
-		delete t;
-		m_delayedMessages.pop_back();
-	}
+	// release whatever the network thread never got to
+	for (QueuedPacket* queued = m_queuedPackets.ReadLock(); queued != nullptr; m_queuedPackets.ReadUnlock(), queued = m_queuedPackets.ReadLock())
+		queued->payload->release();
+
+	DelayedBroadcast delayed;
+	while (m_delayedMessages.pop(delayed))
+		delayed.payload->release();
+
+	releasePayloadCache();
+
+	delete m_workers;
 
 	m_peerInterface->Shutdown(0);
 	RakNet::RakPeerInterface::DestroyInstance(m_peerInterface);
 }
 
+unsigned int Server::minimumChunkBytes(float arenaRadius, float precision) {
+	SnapshotFormat format;
+	format.setPrecision(arenaRadius, MAX_VELOCITY, precision);
+	return snapshotMinimumChunkBytes(format);
+}
+
+// set from a signal handler, the network thread notices within a tick
+static volatile std::sig_atomic_t s_stopRequested = 0;
+
+static void requestStop(int) {
+	s_stopRequested = 1;
+}
+
 void Server::run() {
 
 	// startup the server, and start it listening to clients
 	std::cout << "Starting up the server..." << std::endl;
-	std::cout << "Press ESCAPE to close the server..." << std::endl;
+	std::cout << "Press Ctrl+C to close the server..." << std::endl;
+
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
 
 	// create a socket descriptor to describe this connection
 	RakNet::SocketDescriptor sd(SERVER_PORT, 0);
@@ -44,213 +105,581 @@ void Server::run() {
 	m_peerInterface->Startup(1024, &sd, 1);
 	m_peerInterface->SetMaximumIncomingConnections(1024);
 
-	std::cout << "Server IP: " << m_peerInterface->GetInternalID(RakNet::UNASSIGNED_SYSTEM_ADDRESS).ToString() << std::endl << std::endl;
+	std::cout << "Server IP: " << m_peerInterface->GetInternalID(RakNet::UNASSIGNED_SYSTEM_ADDRESS).ToString() << std::endl;
+	std::cout << "Update Kernel: " << m_updateKernelName << std::endl;
+	std::cout << "Bits Per Entity: " << m_snapshotFormat.entityBits() << std::endl << std::endl;
+	if (m_reportAllocations && !allocationCountingEnabled())
+		std::cout << "Allocations are not counted in this build, configure with -DAIE_COUNT_ALLOCATIONS=ON" << std::endl << std::endl;
+
+	// this thread carries on as the network thread
+	m_running = true;
+	m_simulationThread = std::thread([this]() { simulationLoop(); });
+	networkLoop();
+	m_running = false;
+	m_simulationThread.join();
+}
+
+void Server::networkLoop() {
 
 	RakNet::Packet* packet = nullptr;
-	auto previousTime = std::chrono::high_resolution_clock::now();
-	double microsecondCounter = 0;
 
 	while (true) {
 
-		// update entities at 60fps
-		auto time = std::chrono::high_resolution_clock::now();
-		double deltaMicroseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time - previousTime).count() / 1000.0f;
-		microsecondCounter += deltaMicroseconds;
-		// if 16666 microseconds have passed then update and broadcast entities
-		while (microsecondCounter > 16666) {
-			updateAIEntities(0.016666667f);
-			microsecondCounter -= 16666;
-		}
-		previousTime = time;
-
-		// remove any finished delayed threads
-		for (auto iter = m_delayedMessages.begin(); iter != m_delayedMessages.end(); ) {
-			(*iter)->delayMicroseconds -= deltaMicroseconds;
-			if ((*iter)->delayMicroseconds <= 0) {
-				sendBitStream(&(*iter)->stream);
-				delete (*iter);
-				iter = m_delayedMessages.erase(iter);
-			}
-			else
-				++iter;
-		}
+		// pass on what the simulation thread has encoded, then send any delayed messages that are due
+		uint64_t start = m_networkScheduler.now();
+		sendQueuedPackets();
+		uint64_t queued = m_networkScheduler.now();
+		sendDelayedMessages(queued);
+		uint64_t delayed = m_networkScheduler.now();
+		m_sendQueuedMicroseconds += queued - start;
+		m_delayedMicroseconds += delayed - queued;
 
-		// handle received messages
+		// handle received messages, anything about clients goes to the simulation thread
 		for ( packet = m_peerInterface->Receive();
 			  packet;
 			  m_peerInterface->DeallocatePacket(packet), packet = m_peerInterface->Receive()) {
 
+			ClientEvent event;
+			event.guid = packet->guid.g;
+			event.address = packet->systemAddress;
+			event.sequence = 0;
+			event.chunk = 0;
+			event.x = event.y = 0;
+			bool forward = true;
+
 			switch (packet->data[0]) {
-			case ID_NEW_INCOMING_CONNECTION: {
+			case ID_NEW_INCOMING_CONNECTION:
 				std::cout << "A connection is incoming.\n";
+				event.type = ClientEvent::CONNECTED;
 				break;
-			}
 			case ID_DISCONNECTION_NOTIFICATION:
 				std::cout << "A client has disconnected.\n";
+				event.type = ClientEvent::DISCONNECTED;
 				break;
 			case ID_CONNECTION_LOST:
 				std::cout << "A client lost the connection.\n";
+				event.type = ClientEvent::DISCONNECTED;
+				break;
+			case ID_SNAPSHOT_ACK:
+			case ID_CLIENT_VIEW:
+				forward = readClientMessage(packet->data, packet->length, event);
+				break;
+			case ID_CLOCK_SYNC: {
+				// answered straight away, any time spent here is asymmetric delay in the client's estimate
+				RakNet::TimeUS received = RakNet::GetTimeUS();
+				RakNet::BitStream reply;
+				if (ClockSync::writeReply(packet->data, packet->length, received, RakNet::GetTimeUS(), reply))
+					m_peerInterface->Send(&reply, IMMEDIATE_PRIORITY, UNRELIABLE, 0, packet->systemAddress, false);
+				forward = false;
 				break;
+			}
 			default:
 				std::cout << "Received a message with a unknown id: " << packet->data[0];
+				forward = false;
 				break;
 			}
+
+			if (forward) {
+				ClientEvent* slot = m_clientEvents.WriteLock();
+				*slot = event;
+				m_clientEvents.WriteUnlock();
+			}
 		}
+		m_receiveMicroseconds += m_networkScheduler.now() - delayed;
+
+		if (s_stopRequested)
+			break;
+
+		// sleep until a delayed message is due, the simulation thread hands some over or it is time to poll RakNet again
+		// RakNet's own threads read the socket and pass packets on before Receive sees them, so waking on the socket
+		// would mostly find nothing, a packet waits at most RECEIVE_POLL_MICROSECONDS plus that hand over instead
+		// none of this needs the deadline to the microsecond, so there's no spinning
+		uint64_t deadline = m_networkScheduler.now() + RECEIVE_POLL_MICROSECONDS;
+		if (!m_delayedMessages.empty() && m_delayedMessages.nextDeadline() < deadline)
+			deadline = m_delayedMessages.nextDeadline();
+		m_networkScheduler.sleepUntil(deadline);
+	}
+}
 
-		if (GetAsyncKeyState(VK_ESCAPE))
+bool Server::readClientMessage(const unsigned char* data, unsigned int length, ClientEvent& event) {
+
+	if (length < sizeof(RakNet::MessageID))
+		return false;
+
+	RakNet::BitStream stream(const_cast<unsigned char*>(data), length, false);
+	stream.IgnoreBytes(sizeof(RakNet::MessageID));
+
+	switch (data[0]) {
+	case ID_SNAPSHOT_ACK:
+		event.type = ClientEvent::ACK;
+		return stream.Read(event.sequence) && stream.Read(event.chunk);
+	case ID_CLIENT_VIEW:
+		event.type = ClientEvent::VIEW;
+		return stream.Read(event.x) && stream.Read(event.y);
+	default:
+		return false;
+	}
+}
+
+void Server::attachLoopback(LoopbackTransport* transport) {
+
+	m_loopback = transport;
+
+	// every client acks every chunk, and here the queue is filled and emptied on the ticking thread,
+	// so it is grown up front to a few ticks' worth rather than a node at a time whenever loss bunches acks up
+	// writing ahead and cancelling leaves the nodes in the ring
+	unsigned int events = transport->clientCount() * snapshotChunkCount((unsigned int)m_entities.size(), m_snapshotEntitiesPerChunk) * LOOPBACK_EVENT_TICKS;
+	ClientEvent* first = m_clientEvents.WriteLock();
+	for (unsigned int i = 1; i < events; ++i)
+		m_clientEvents.WriteLock();
+	m_clientEvents.CancelWriteLock(first);
+
+	for (unsigned int i = 0; i < transport->clientCount(); ++i) {
+		ClientEvent* slot = m_clientEvents.WriteLock();
+		slot->type = ClientEvent::CONNECTED;
+		slot->guid = transport->guid(i);
+		slot->address = transport->address(i);
+		m_clientEvents.WriteUnlock();
+	}
+}
+
+void Server::stepLoopback() {
+
+	// the same hand over as the threaded loops, only both ends are on this thread
+	LoopbackTransport::Packet packet;
+	while (m_loopback->receiveFromClient(packet)) {
+		ClientEvent event;
+		event.guid = m_loopback->guid(packet.client);
+		event.address = m_loopback->address(packet.client);
+		event.sequence = 0;
+		event.chunk = 0;
+		event.x = event.y = 0;
+		if (readClientMessage(packet.data(), packet.length(), event)) {
+			ClientEvent* slot = m_clientEvents.WriteLock();
+			*slot = event;
+			m_clientEvents.WriteUnlock();
+		}
+		m_loopback->release(packet);
+	}
+
+	applyClientEvents();
+	updateAIEntities(0.016666667f);
+
+	sendQueuedPackets();
+	sendDelayedMessages(m_loopback->now());
+}
+
+void Server::simulationLoop() {
+
+	uint64_t nextTick = m_scheduler.now() + TICK_MICROSECONDS;
+
+	while (m_running) {
+
+		// update entities at 60fps, running the ticks that have come due
+		unsigned long long allocations = allocationCount();
+		uint64_t time = m_scheduler.now();
+		if (time >= nextTick) {
+			applyClientEvents();
+
+			uint64_t due = (time - nextTick) / TICK_MICROSECONDS + 1;
+			uint64_t steps = due < m_maxCatchUpSteps ? due : m_maxCatchUpSteps;
+			m_tickJitter.record(time - nextTick);
+
+			// only the final state of a catch-up is worth sending
+			for (uint64_t step = 0; step < steps; ++step)
+				updateAIEntities(0.016666667f, step + 1 == steps);
+			nextTick += due * TICK_MICROSECONDS;
+
+			uint64_t batch = m_scheduler.now() - time;
+			m_timing.ticks += steps;
+			m_timing.catchUpTicks += steps - 1;
+			m_timing.droppedTicks += due - steps;
+			if (batch > TICK_MICROSECONDS)
+				++m_timing.overruns;
+			if (batch > m_timing.worstBatchMicroseconds)
+				m_timing.worstBatchMicroseconds = batch;
+		}
+		m_tickAllocations += allocationCount() - allocations;
+
+		if (m_reportAllocations && allocationCountingEnabled() && m_tick >= m_allocationReportTick + ALLOCATION_REPORT_TICKS) {
+			std::cout << "Heap allocations by the simulation thread in the last " << m_tick - m_allocationReportTick << " ticks: " << m_tickAllocations << std::endl;
+			m_allocationReportTick = m_tick;
+			m_tickAllocations = 0;
+		}
+
+		if (m_reportTiming && m_timing.ticks + m_timing.droppedTicks >= TIMING_REPORT_TICKS)
+			printTiming();
+
+		m_scheduler.waitUntil(nextTick);
+	}
+}
+
+void Server::applyClientEvents() {
+
+	for (ClientEvent* event = m_clientEvents.ReadLock(); event != nullptr; m_clientEvents.ReadUnlock(), event = m_clientEvents.ReadLock()) {
+		switch (event->type) {
+		case ClientEvent::CONNECTED: {
+			ClientState& client = m_clients[event->guid];
+			client.address = event->address;
+			client.snapshots.clear();
+			client.hasView = false;
+			client.viewX = client.viewY = 0;
+			client.priority.clear();
+			break;
+		}
+		case ClientEvent::DISCONNECTED:
+			m_clients.erase(event->guid);
+			break;
+		case ClientEvent::ACK: {
+			auto iter = m_clients.find(event->guid);
+			if (iter != m_clients.end())
+				iter->second.snapshots.acknowledge(event->sequence, event->chunk);
+			break;
+		}
+		case ClientEvent::VIEW: {
+			auto iter = m_clients.find(event->guid);
+			if (iter != m_clients.end()) {
+				iter->second.hasView = true;
+				iter->second.viewX = event->x;
+				iter->second.viewY = event->y;
+			}
 			break;
+		}
+		}
 	}
 }
 
-// Add more data like the timestamp not remove contents
-// Stop setting/ sending ID_TIMESTAMP every packet?
-void Server::broadcastFaultyData(const char* data, unsigned int size) 
+void Server::queuePacket(SharedPayload* payload, const RakNet::SystemAddress& address) {
+	payload->addReference();
+	QueuedPacket* slot = m_queuedPackets.WriteLock();
+	slot->address = address;
+	slot->payload = payload;
+	m_queuedPackets.WriteUnlock();
+}
+
+void Server::sendQueuedPackets() {
+	for (QueuedPacket* queued = m_queuedPackets.ReadLock(); queued != nullptr; m_queuedPackets.ReadUnlock(), queued = m_queuedPackets.ReadLock()) {
+		sendFaultyData(queued->payload, queued->address);
+		queued->payload->release();
+	}
+}
+
+void Server::sendFaultyData(SharedPayload* payload, const RakNet::SystemAddress& address)
 {
-	// Used for timestamping
-	RakNet::MessageID useTimeStamp; // Assign this to ID_TIMESTAMP
-	RakNet::Time timeStamp; // Put the system time in here returned by RakNet::GetTime()
-	useTimeStamp = ID_TIMESTAMP; // MessageIdentifiers.h line: 139
-	timeStamp = RakNet::GetTime();
-
-	// lose messages every so often
-	if (randf() * 100 < m_packetlossPercentage)
+	uint64_t delay;
+	if (!m_faults.apply(delay))
 		return;
 
-	// delay messages every so often
-	if (randf() * 100 < m_delayPercentage) {
-		DelayedBroadcast* b = new DelayedBroadcast;
-		b->stream.Write((RakNet::MessageID)useTimeStamp);
-		b->stream.Write((RakNet::MessageID)GameMessages::ID_ENTITY_LIST);
-		b->stream.Write(timeStamp); 
-		b->stream.Write(size);
-		b->stream.Write(data, size);
-		float delay = randf() * m_delayRange;
-		b->delayMicroseconds = (double)(delay * 1000.0 * 1000.0);
-		m_delayedMessages.push_back(b);
+	if (delay > 0) {
+		DelayedBroadcast b;
+		payload->addReference();
+		b.payload = payload;
+		b.address = address;
+		m_delayedMessages.push(networkTime() + delay, b);
 	}
 	else {
 		// just send the stream
-		RakNet::BitStream stream;
-		stream.Write((RakNet::MessageID)useTimeStamp);
-		stream.Write((RakNet::MessageID)GameMessages::ID_ENTITY_LIST);
-		stream.Write(timeStamp);
-		stream.Write(size);
-		stream.Write(data, size);
-		sendBitStream(&stream);
+		sendPayload(payload, address);
 	}
 }
 
-float Server::randf() {
-	return rand() / (float)RAND_MAX;
+void Server::sendDelayedMessages(uint64_t now) {
+	DelayedBroadcast delayed;
+	while (m_delayedMessages.popExpired(now, delayed)) {
+		sendPayload(delayed.payload, delayed.address);
+		delayed.payload->release();
+	}
 }
 
-void Server::sendBitStream(RakNet::BitStream* stream) {
-	m_peerInterface->Send(stream, HIGH_PRIORITY, UNRELIABLE, 0, RakNet::UNASSIGNED_SYSTEM_ADDRESS, true);
+void Server::sendPayload(SharedPayload* payload, const RakNet::SystemAddress& address) {
+	if (m_loopback != nullptr)
+		m_loopback->sendToClient(payload, address);
+	else
+		m_peerInterface->Send(&payload->stream, HIGH_PRIORITY, UNRELIABLE, 0, address, false);
 }
 
 void Server::setupAIEntities(unsigned int count) {
-	unsigned int nextId = 0;
-	m_aiEntities.resize(count);
-	m_aiServerEntities.resize(count);
-	for (auto& ai : m_aiEntities) {
+	m_entities.resize(count);
+	m_jitter.resize(count);
+	m_pendingTeleports.assign(count, 0);
+
+	Random random(m_seed, RANDOM_STREAM_SETUP);
+	for (unsigned int i = 0; i < count; ++i) {
 		// random position and facing
-		float facing = randf() * 3.14159f * 2;
-		float offsetDir = randf() * 3.14159f * 2;
-		float offset = m_arenaRadius * randf();
+		float facing = random.randf() * 3.14159f * 2;
+		float offsetDir = random.randf() * 3.14159f * 2;
+		float offset = m_arenaRadius * random.randf();
+
+		m_entities.wanderAngle[i] = random.randf() * 3.14159f * 2;
 
-		m_aiServerEntities[nextId].data = &ai;
-		m_aiServerEntities[nextId].wanderAngle = randf() * 3.14159f * 2;
+		m_entities.positionX[i] = sinf(offsetDir) * offset;
+		m_entities.positionY[i] = cosf(offsetDir) * offset;
 
-		ai.id = nextId++;
-		ai.position.x = sinf(offsetDir) * offset;
-		ai.position.y = cosf(offsetDir) * offset;
+		m_entities.velocityX[i] = sinf(facing) * MAX_VELOCITY;
+		m_entities.velocityY[i] = cosf(facing) * MAX_VELOCITY;
 
-		ai.velocity.x = sinf(facing) * MAX_VELOCITY;
-		ai.velocity.y = cosf(facing) * MAX_VELOCITY;
+		m_entities.teleported[i] = 0;
 	}
 }
 
-void Server::updateAIEntities(float deltaTime) {
+void Server::updateAIEntities(float deltaTime, bool broadcast) {
 
-	for (auto& ai : m_aiServerEntities) {
+	m_tickDeltaTime = deltaTime;
+	m_broadcastStep = broadcast;
 
-		// jitter offset
-		ai.wanderAngle += (randf() * 2 - 1) * WANDER_JITTER;
+	// workers quantise straight into the history slot for this tick's snapshot
+	if (broadcast) {
+		++m_snapshotSequence;
+		m_snapshot = &m_snapshots.prepare(m_snapshotSequence);
+		m_snapshot->resize(m_entities.size());
+	}
 
-		AIVector f = ai.data->velocity;
-		f.normalise();
+	uint64_t start = m_scheduler.now();
+	m_workers->run([this](unsigned int worker) { updateAIEntityRange(worker); });
+	++m_tick;
+
+	uint64_t simulated = m_scheduler.now();
+	m_timing.simulateMicroseconds += simulated - start;
+	if (!broadcast)
+		return;
+
+	m_snapshots.commit(m_snapshotSequence);
+
+	if (m_interestRadius > 0 && m_bandwidthKbps <= 0)
+		updateInterestGrid();
+
+	sendSnapshots();
+	m_timing.sendMicroseconds += m_scheduler.now() - simulated;
+}
 
-		// wander force
-		ai.data->velocity.x += sinf(ai.wanderAngle) * WANDER_RADIUS + f.x * WANDER_OFFSET;
-		ai.data->velocity.y += cosf(ai.wanderAngle) * WANDER_RADIUS + f.y * WANDER_OFFSET;
+void Server::printTiming() {
 
-		// truncate
-		if (ai.data->velocity.lengthSqr() > (MAX_VELOCITY * MAX_VELOCITY)) {
-			ai.data->velocity.normalise();
-			ai.data->velocity.x *= MAX_VELOCITY;
-			ai.data->velocity.y *= MAX_VELOCITY;
+	m_tickJitter.print(std::cout);
+	m_tickJitter.reset();
+
+	uint64_t ticks = m_timing.ticks > 0 ? m_timing.ticks : 1;
+	std::cout << "Ticks run: " << m_timing.ticks << ", catch-up: " << m_timing.catchUpTicks << ", dropped: " << m_timing.droppedTicks
+		<< ", overrun batches: " << m_timing.overruns << ", worst batch us: " << m_timing.worstBatchMicroseconds << std::endl;
+	std::cout << "Per tick us - simulate: " << m_timing.simulateMicroseconds / ticks << ", snapshot encode: " << m_timing.sendMicroseconds / ticks
+		<< ", network thread sends: " << m_sendQueuedMicroseconds.exchange(0) / ticks << ", delayed sends: " << m_delayedMicroseconds.exchange(0) / ticks
+		<< ", receive: " << m_receiveMicroseconds.exchange(0) / ticks << std::endl;
+
+	memset(&m_timing, 0, sizeof(m_timing));
+}
+
+void Server::sendSnapshots() {
+
+	SnapshotHeader header;
+	header.sequence = m_snapshotSequence;
+	header.format = m_snapshotFormat;
+	unsigned int totalEntities = (unsigned int)m_snapshot->size();
+
+	// a keyframe of a whole range fills its packet, nothing sent is bigger
+	unsigned int overheadBits = snapshotChunkOverheadBits();
+	m_payloadPool.setPayloadBits(overheadBits + m_snapshotEntitiesPerChunk * m_snapshotFormat.entityBits());
+
+	// this tick's share of the bandwidth, less what packet overhead and the bits of every unsent entity will take
+	int budgetBits = 0;
+	if (m_bandwidthKbps > 0) {
+		unsigned int tickBits = (unsigned int)(m_bandwidthKbps * 1000 * m_tickDeltaTime);
+		unsigned int chunks = snapshotChunkCount(totalEntities, m_snapshotEntitiesPerChunk);
+		budgetBits = (int)tickBits - (int)(chunks * overheadBits) - (int)(totalEntities * SNAPSHOT_UNCHANGED_BITS);
+	}
+
+	// last tick's payloads are only still alive if a delayed send holds them
+	releasePayloadCache();
+	m_snapshotTime = m_loopback != nullptr ? m_loopback->now() / 1000 : RakNet::GetTime();
+
+	for (auto& pair : m_clients) {
+		ClientState& client = pair.second;
+
+		// each range as a delta against the snapshot the client last acknowledged it in if that is still usable, otherwise as a keyframe
+		SnapshotDelta delta;
+		client.snapshots.selectBaseline(m_snapshots, m_snapshotSequence, m_snapshotEntitiesPerChunk, m_snapshotBaseline, delta);
+
+		// keyframes go out whole, everything on them is as fresh as it gets
+		const unsigned char* relevant = nullptr;
+		if (m_bandwidthKbps > 0) {
+			if (delta.hasBaseline) {
+				prioritiseEntities(client, delta, budgetBits);
+				relevant = m_relevant.data();
+			}
+			else
+				client.priority.assign(totalEntities, 0.0f);
+		}
+		// clients that haven't said where they are looking yet get everything
+		else if (m_interestRadius > 0 && client.hasView) {
+			findRelevantEntities(client, delta);
+			relevant = m_relevant.data();
 		}
 
-		// move
-		ai.data->position.x += ai.data->velocity.x * deltaTime;
-		ai.data->position.y += ai.data->velocity.y * deltaTime;
+		client.snapshots.selectEntities(m_snapshots, m_snapshotFormat, m_snapshotSequence, relevant, m_snapshotEntities, delta);
 
-		ai.data->teleported = false;
+		// clients sharing a chunk's baseline share its encoding, anyone sent a subset of the range gets their own
+		for (unsigned int c = 0; c < delta.chunkCount; ++c) {
+			const SnapshotChunkDelta& chunk = delta.chunks[c];
+			if (!chunk.shared) {
+				SharedPayload* payload = encodeChunk(header, delta, c);
+				queuePacket(payload, client.address);
+				payload->release();
+				continue;
+			}
 
-		// teleport if needed to stay in arena
-		if (ai.data->position.lengthSqr() > (m_arenaRadius * m_arenaRadius)) {
-			ai.data->teleported = true;
-			AIVector offset = ai.data->position;
-			offset.normalise();
-			ai.data->position.x -= offset.x * m_arenaRadius * 2;
-			ai.data->position.y -= offset.y * m_arenaRadius * 2;
+			unsigned int slot = chunk.baseline != nullptr ? chunk.baselineSequence % SNAPSHOT_HISTORY : SNAPSHOT_HISTORY;
+			PayloadCacheEntry& entry = m_payloadCache[c * (SNAPSHOT_HISTORY + 1) + slot];
+			if (!entry.valid || entry.baselineSequence != chunk.baselineSequence) {
+				if (entry.valid)
+					entry.payload->release();
+				entry.payload = encodeChunk(header, delta, c);
+				entry.valid = true;
+				entry.baselineSequence = chunk.baselineSequence;
+			}
+			queuePacket(entry.payload, client.address);
 		}
 	}
 
-	// broadcast entities
-	broadcastFaultyData((const char*)m_aiEntities.data(), m_aiEntities.size() * sizeof(AIEntity));
+	if (m_loopback == nullptr)
+		m_networkScheduler.wake();
 }
 
-// application main, uses command line options
-void main(int argc, char* argv[]) {
-
-	std::cout << "Use command line options: -count N -radius M -loss X -delay Y -range Z" << std::endl;
-	std::cout << "N: entity count as int" << std::endl;
-	std::cout << "M: arena radius as float" << std::endl;
-	std::cout << "X: packetloss percentage as float" << std::endl;
-	std::cout << "Y: packet delay percentage as float" << std::endl;
-	std::cout << "Z: delay range in seconds as float" << std::endl << std::endl;
-
-	unsigned int entityCount = 100;
-	float radius = 50;
-	float packetlossPercentage = 10;
-	float delayPercentage = 10;
-	float delayRange = 1;
-
-	for (int i = 0; i < argc; ++i) {
-		if (strcmp(argv[i], "-count") == 0) {
-			entityCount = (unsigned int)atoi(argv[i + 1]);
-		}
-		if (strcmp(argv[i], "-radius") == 0) {
-			radius = (float)atof(argv[i + 1]);
-		}
-		if (strcmp(argv[i], "-loss") == 0) {
-			packetlossPercentage = (float)atof(argv[i + 1]);
+SharedPayload* Server::encodeChunk(SnapshotHeader& header, const SnapshotDelta& delta, unsigned int chunk) {
+	SharedPayload* payload = m_payloadPool.acquire();
+	payload->stream.Write((RakNet::MessageID)GameMessages::ID_ENTITY_LIST);
+	payload->stream.Write(m_snapshotTime);
+	writeSnapshotChunk(payload->stream, header, delta, chunk);
+	return payload;
+}
+
+void Server::releasePayloadCache() {
+	for (auto& entry : m_payloadCache) {
+		if (entry.valid)
+			entry.payload->release();
+		entry.valid = false;
+	}
+}
+
+void Server::updateInterestGrid() {
+	// rebuilt every tick, every entity moves every tick anyway
+	m_interestGrid.build(m_entities.positionX.data(), m_entities.positionY.data(), m_entities.size());
+}
+
+void Server::findRelevantEntities(const ClientState& client, const SnapshotDelta& delta) {
+
+	unsigned int count = m_entities.size();
+	m_relevant.resize(count);
+
+	// distant entities take turns, a different slice each tick
+	// baselines step by the ack round trip, which can keep skipping an entity's turn, so one whose value
+	// is about to leave the history is sent anyway or its chunk would need a keyframe
+	unsigned int trickle = (unsigned int)(m_tick % INTEREST_TRICKLE_TICKS);
+	for (unsigned int i = 0; i < count; ++i)
+		m_relevant[i] = (i % INTEREST_TRICKLE_TICKS) == trickle || baselineExpiring(client, delta, i);
+
+	// the grid narrows it down to nearby cells, then a distance check against the circle
+	m_interestGrid.markWithin(client.viewX, client.viewY, m_interestRadius, m_entities.positionX.data(), m_entities.positionY.data(), m_relevant.data());
+}
+
+bool Server::baselineExpiring(const ClientState& client, const SnapshotDelta& delta, unsigned int entity) const {
+	const SnapshotChunkDelta& chunk = delta.chunks[entity / delta.entitiesPerChunk];
+	if (chunk.baseline == nullptr)
+		return false;
+
+	// this tick's frame only becomes a baseline once acknowledged, about as far ahead as the current baseline is behind
+	unsigned int age = m_snapshotSequence - client.snapshots.baselineSource(entity);
+	unsigned int roundTrip = m_snapshotSequence - chunk.baselineSequence;
+	return age + roundTrip >= SNAPSHOT_HISTORY - PRIORITY_FORCE_MARGIN;
+}
+
+void Server::prioritiseEntities(ClientState& client, const SnapshotDelta& delta, int budgetBits) {
+
+	const QuantizedEntity* current = m_snapshot->data();
+	unsigned int count = (unsigned int)m_snapshot->size();
+	client.priority.resize(count, 0.0f);
+	m_relevant.assign(count, 0);
+	m_priorityOrder.resize(count);
+
+	float falloff = m_interestRadius > 0 ? m_interestRadius : m_arenaRadius * 0.25f;
+	for (unsigned int i = 0; i < count; ++i) {
+		m_priorityOrder[i] = i;
+
+		// keyframe chunks go out whole, and an entity whose value is about to leave the history has to go now,
+		// or its chunk would need a keyframe
+		if (delta.baselineOf(i) == nullptr || baselineExpiring(client, delta, i)) {
+			client.priority[i] = FLT_MAX;
+			continue;
 		}
-		if (strcmp(argv[i], "-delay") == 0) {
-			delayPercentage = (float)atof(argv[i + 1]);
+
+		// closer to the view matters more
+		float relevance = 1;
+		if (client.hasView) {
+			float dx = m_entities.positionX[i] - client.viewX;
+			float dy = m_entities.positionY[i] - client.viewY;
+			relevance = 1 / (1 + sqrtf(dx * dx + dy * dy) / falloff);
 		}
-		if (strcmp(argv[i], "-range") == 0) {
-			delayRange = (float)atof(argv[i + 1]);
+
+		// as does how far the velocity has turned from what the client has
+		const QuantizedEntity& e = current[i];
+		const QuantizedEntity& b = *delta.baselineOf(i);
+		float dvx = m_snapshotFormat.dequantizeVelocity(e.velocityX) - m_snapshotFormat.dequantizeVelocity(b.velocityX);
+		float dvy = m_snapshotFormat.dequantizeVelocity(e.velocityY) - m_snapshotFormat.dequantizeVelocity(b.velocityY);
+		relevance += VELOCITY_PRIORITY * sqrtf(dvx * dvx + dvy * dvy) / MAX_VELOCITY;
+
+		if (e.teleported)
+			relevance += TELEPORT_PRIORITY;
+
+		client.priority[i] = std::min(client.priority[i] + relevance, FLT_MAX * 0.5f);
+	}
+
+	std::sort(m_priorityOrder.begin(), m_priorityOrder.end(), [&client](unsigned int a, unsigned int b) {
+		return client.priority[a] > client.priority[b];
+	});
+
+	// greedy fill, skipping anything too big for what is left so smaller entities can still use it
+	// unsent entities already have their bits taken out of the budget
+	for (unsigned int id : m_priorityOrder) {
+		bool forced = client.priority[id] == FLT_MAX;
+		int cost = (int)snapshotEntityBits(m_snapshotFormat, current[id], delta.baselineOf(id)) - (int)SNAPSHOT_UNCHANGED_BITS;
+		if (forced || cost <= budgetBits) {
+			m_relevant[id] = 1;
+			budgetBits -= cost;
+			client.priority[id] = 0;
 		}
 	}
+}
+
+void Server::updateAIEntityRange(unsigned int worker) {
+
+	// ranges are kept to whole cache lines of floats so workers don't share lines and the kernels stay on full lanes
+	unsigned int first, count;
+	m_workers->getRange(worker, m_entities.size(), 16, first, count);
+	if (count == 0)
+		return;
 
-	std::cout << "Entity Count: " << entityCount << std::endl;
-	std::cout << "Arena Radius: " << radius << std::endl;
-	std::cout << "Packet Loss Percentage: " << packetlossPercentage << std::endl;
-	std::cout << "Packet Delay Percentage: " << delayPercentage << std::endl;
-	std::cout << "Max Delay Time in Seconds: " << delayRange << std::endl << std::endl;
+	// draw the jitter up front so the kernel itself has no dependency on the generator
+	for (unsigned int i = first; i < first + count; ++i)
+		m_jitter[i] = randomCounterf(m_seed, RANDOM_STREAM_SIMULATION, m_tick, i) * 2 - 1;
+
+	AIWanderParams params;
+	params.deltaTime = m_tickDeltaTime;
+	params.arenaRadius = m_arenaRadius;
+	params.maxVelocity = MAX_VELOCITY;
+	params.wanderJitter = WANDER_JITTER;
+	params.wanderOffset = WANDER_OFFSET;
+	params.wanderRadius = WANDER_RADIUS;
+	m_updateKernel(m_entities, m_jitter.data() + first, first, count, params);
+
+	// a teleport during a catch-up step still has to reach clients with the next snapshot
+	unsigned char* teleported = m_entities.teleported.data();
+	if (!m_broadcastStep) {
+		for (unsigned int i = first; i < first + count; ++i)
+			m_pendingTeleports[i] |= teleported[i];
+		return;
+	}
+	for (unsigned int i = first; i < first + count; ++i) {
+		teleported[i] |= m_pendingTeleports[i];
+		m_pendingTeleports[i] = 0;
+	}
 
-	Server server(entityCount, radius, packetlossPercentage, delayPercentage, delayRange);
-	server.run();
-}
\ No newline at end of file
+	// quantise for the wire in its own pass so the update loop never touches it
+	m_entities.quantize(m_snapshotFormat, m_snapshot->data() + first, first, count);
+}
@@ -2,60 +2,291 @@
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include <thread>
+#include <atomic>
 
 #include <RakPeerInterface.h>
 #include <BitStream.h>
+#include <SingleProducerConsumer.h>
 
 #include "../src/AIEntity.h"
+#include "../src/AIEntityStore.h"
+#include "../src/AIEntityKernel.h"
+#include "../src/WorkerPool.h"
+#include "../src/Random.h"
+#include "../src/SnapshotSender.h"
+#include "../src/SharedPayload.h"
+#include "../src/DelayQueue.h"
+#include "../src/TickScheduler.h"
+#include "../src/FaultModel.h"
+#include "../src/LoopbackTransport.h"
+#include "../src/ClockSync.h"
+#include "../src/InterestGrid.h"
 
 class Server {
 public:
 
-	Server(unsigned int entityCount, float arenaRadius, float packetlossPercentage, float delayPercentage, float delayRange);
+	Server(unsigned int entityCount, float arenaRadius, float packetlossPercentage, float delayPercentage, float delayRange, float precision = 0.01f, unsigned int chunkBytes = 1200, uint64_t seed = 1, unsigned int threadCount = 1, const char* preferredKernel = nullptr, float interestRadius = 0, float bandwidthKbps = 0, bool reportAllocations = false, bool reportTiming = false, unsigned int maxCatchUpSteps = 4);
 	~Server();
 
 	void	run();
+
+	// runs without raknet or threads for benchmarks, every packet goes through transport
+	// and time only moves when the caller advances the transport's clock
+	// each of its clients is connected straight away, nothing else may be running on this server
+	void	attachLoopback(LoopbackTransport* transport);
+
+	// one tick on the calling thread, takes in what clients have sent by now, simulates and sends
+	// the caller advances the clock by a tick between steps
+	void	stepLoopback();
+
+	// the smallest -chunk that fits one entity at this arena radius and precision, see snapshotMinimumChunkBytes
+	static unsigned int	minimumChunkBytes(float arenaRadius, float precision);
 			
 private:
+
+	struct ClientState;
+
+	// the simulation thread ticks, encodes snapshots and hands the packets over to the network thread,
+	// which owns raknet, the fault model and the delay queue, so receiving never holds up a tick
+	void	simulationLoop();
+	void	networkLoop();
+
+	// simulation thread, applies the connects, disconnects, acks and views the network thread has passed on
+	void	applyClientEvents();
+
+	// simulation thread, hands a packet to the network thread, which takes a reference to the payload
+	void	queuePacket(SharedPayload* payload, const RakNet::SystemAddress& address);
+
+	// network thread, sends the handed over packets through the fault model
+	void	sendQueuedPackets();
 	
-	// occasionally loses or delays packets
-	void	broadcastFaultyData(const char* data, unsigned int size);
+	// occasionally loses or delays packets, a delayed packet holds a reference to the payload rather than a copy
+	void	sendFaultyData(SharedPayload* payload, const RakNet::SystemAddress& address);
+
+	// sends the payload immediately, through raknet or the loopback transport
+	void	sendPayload(SharedPayload* payload, const RakNet::SystemAddress& address);
+
+	// sends each client the newest snapshot as a delta against the last one it acknowledged
+	void	sendSnapshots();
+
+	// encodes one chunk of the delta into a payload the caller holds a reference to
+	SharedPayload*	encodeChunk(SnapshotHeader& header, const SnapshotDelta& delta, unsigned int chunk);
+
+	// indexes entity positions for this tick's interest queries
+	void	updateInterestGrid();
+
+	// marks the entities near the view in m_relevant, plus this tick's share of the distant ones, and any whose baseline value is about to leave the history
+	void	findRelevantEntities(const ClientState& client, const SnapshotDelta& delta);
+
+	// true when the client's value of an entity would leave the history before a frame sent now is acknowledged,
+	// so it has to be sent now or its chunk would need a keyframe
+	bool	baselineExpiring(const ClientState& client, const SnapshotDelta& delta, unsigned int entity) const;
 
-	// sends stream immediately
-	void	sendBitStream(RakNet::BitStream* stream);
+	// grows the client's priorities and marks in m_relevant the most important entities that fit in budgetBits
+	void	prioritiseEntities(ClientState& client, const SnapshotDelta& delta, int budgetBits);
 
 	// set up / update AI data and broadcast
+	// catch-up steps pass broadcast false, they only simulate and nothing is quantised or sent
 	void	setupAIEntities(unsigned int count);
-	void	updateAIEntities(float deltaTime);
+	void	updateAIEntities(float deltaTime, bool broadcast = true);
 
-	// helper method, returns random range [0,1]
-	static float	randf();
+	// runs on each worker, updates and packs that worker's contiguous range of entities
+	void	updateAIEntityRange(unsigned int worker);
 
 	// wander data
 	float		m_arenaRadius;
-	const float MAX_VELOCITY = 10;
+	static constexpr float MAX_VELOCITY = 10;
 	const float WANDER_JITTER = 0.05f;
 	const float WANDER_OFFSET = 2.5f;
 	const float WANDER_RADIUS = 1.5f;
 
-	// this data is sent to clients
-	std::vector<AIEntity>		m_aiEntities;
+	// simulation data, one contiguous array per field
+	AIEntityStore				m_entities;
+
+	// per tick random jitter, drawn before the update kernel runs
+	std::vector<float>			m_jitter;
+
+	// each worker owns a contiguous range of entities
+	WorkerPool*					m_workers;
+	float						m_tickDeltaTime;
+
+	// jitter is drawn per entity from (seed, tick, id) so runs replay bit for bit at any thread count
+	uint64_t					m_seed;
+	uint64_t					m_tick;
+
+	// set for a step that is sent, catch-up steps remember teleports in m_pendingTeleports for the next one
+	bool						m_broadcastStep;
+	std::vector<unsigned char>	m_pendingTeleports;
+
+	// wander / steer / integrate kernel chosen for this CPU
+	AIUpdateKernel				m_updateKernel;
+	const char*					m_updateKernelName;
+
+	// this data is sent to clients, quantised from m_entities after each update
+	// recent snapshots are kept so clients can be sent deltas against one they already have
+	SnapshotFormat				m_snapshotFormat;
+	SnapshotHistory				m_snapshots;
+	unsigned int				m_snapshotSequence;
+	std::vector<QuantizedEntity>*	m_snapshot;
+
+	// every packet of a tick carries the same timestamp
+	RakNet::Time				m_snapshotTime;
+
+	// each snapshot is split into fixed ranges of entities whose keyframe fits in one datagram
+	unsigned int				m_snapshotChunkBytes;
+	unsigned int				m_snapshotEntitiesPerChunk;
+
+	// encoded packets are recycled, keeping the buffers they grew to
+	SharedPayloadPool			m_payloadPool;
+
+	// a tick's chunks are encoded once per distinct baseline and shared by every client that needs them,
+	// SNAPSHOT_HISTORY + 1 entries per chunk, the last holds the keyframe, the rest are indexed by baseline sequence
+	struct PayloadCacheEntry {
+		bool			valid;
+		unsigned int	baselineSequence;
+		SharedPayload*	payload;
+	};
+	std::vector<PayloadCacheEntry>	m_payloadCache;
+
+	// drops this tick's references to cached payloads
+	void	releasePayloadCache();
+
+	// per client scratch for building what is sent when it only gets a subset of the entities
+	std::vector<QuantizedEntity>	m_snapshotEntities;
+	std::vector<QuantizedEntity>	m_snapshotBaseline;
 
-	// this data is NOT sent to clients, handles wandering
-	std::vector<AIServerEntity>	m_aiServerEntities;
+	struct ClientState {
+		RakNet::SystemAddress	address;
+		SnapshotSender			snapshots;
+
+		// where the client is looking from, reported with ID_CLIENT_VIEW
+		bool					hasView;
+		float					viewX, viewY;
+
+		// per entity, grows every tick it isn't sent, only used with a bandwidth budget
+		std::vector<float>		priority;
+	};
+	std::unordered_map<uint64_t, ClientState>	m_clients;
+
+	// interest management, clients are sent entities within the radius of their view every tick
+	// and each distant entity once every INTEREST_TRICKLE_TICKS, 0 radius sends everything every tick
+	// the trickle must stay well inside the snapshot history or unsent entities age out of every baseline
+	float						m_interestRadius;
+	const unsigned int			INTEREST_TRICKLE_TICKS = 10;
+	InterestGrid				m_interestGrid;
+	std::vector<unsigned char>	m_relevant;
+
+	// bandwidth budget per client, each tick is filled with the highest priority entities, 0 sends everything
+	// an entity gains priority each tick it waits, more when it is close to the view, its velocity has changed or it teleported
+	// with a budget the interest radius only sets how fast priority falls off with distance
+	float						m_bandwidthKbps;
+	const float					VELOCITY_PRIORITY = 2;
+	const float					TELEPORT_PRIORITY = 100;
+
+	// entities are sent regardless of budget or distance this many ticks before their value would leave the snapshot history,
+	// counting the ticks until the frame they are sent in is acknowledged
+	const unsigned int			PRIORITY_FORCE_MARGIN = 4;
+	std::vector<unsigned int>	m_priorityOrder;
 
 	// raknet
 	const unsigned short PORT = 5456;
 	RakNet::RakPeerInterface*	m_peerInterface;
 
-	// faults
-	float					m_packetlossPercentage;
-	float					m_delayPercentage;
-	float					m_delayRange;
+	// set when benchmarking in process, replaces raknet and the network scheduler's clock
+	LoopbackTransport*		m_loopback;
+
+	// the network scheduler's clock, or the loopback transport's virtual one
+	uint64_t	networkTime() { return m_loopback != nullptr ? m_loopback->now() : m_networkScheduler.now(); }
+
+	// faults, only used on the network thread
+	FaultModel				m_faults;
 	
+	// held by value and ordered by when they are due, in microseconds on networkTime()'s clock
 	struct DelayedBroadcast {
-		double delayMicroseconds;
-		RakNet::BitStream stream;
+		RakNet::SystemAddress address;
+		SharedPayload* payload;
+	};
+	DelayQueue<DelayedBroadcast>	m_delayedMessages;
+
+	// sends every delayed packet due by now
+	void	sendDelayedMessages(uint64_t now);
+
+	// threads
+	std::thread				m_simulationThread;
+	std::atomic<bool>		m_running;
+
+	// network thread to simulation thread
+	struct ClientEvent {
+		enum Type { CONNECTED, DISCONNECTED, ACK, VIEW };
+		Type					type;
+		uint64_t				guid;
+		RakNet::SystemAddress	address;
+		unsigned int			sequence;
+		unsigned short			chunk;
+		float					x, y;
+	};
+	DataStructures::SingleProducerConsumer<ClientEvent>		m_clientEvents;
+	const unsigned int		LOOPBACK_EVENT_TICKS = 4;
+
+	// reads an ID_SNAPSHOT_ACK or ID_CLIENT_VIEW into event, false for anything else or if it is cut short
+	bool	readClientMessage(const unsigned char* data, unsigned int length, ClientEvent& event);
+
+	// simulation thread to network thread, each holding a reference to its payload
+	struct QueuedPacket {
+		RakNet::SystemAddress	address;
+		SharedPayload*			payload;
 	};
-	std::list<DelayedBroadcast*>	m_delayedMessages;
+	DataStructures::SingleProducerConsumer<QueuedPacket>	m_queuedPackets;
+
+	// heap allocations made by the simulation thread while it ticks, printed every ALLOCATION_REPORT_TICKS when asked for
+	// once the pools, queues and scratch arrays have grown this should stay at zero
+	// worker threads' allocations are not counted, with -threads above 1 only the share on this thread is
+	bool					m_reportAllocations;
+	unsigned long long		m_tickAllocations;
+	uint64_t				m_allocationReportTick;
+	const unsigned int		ALLOCATION_REPORT_TICKS = 300;
+
+	// each loop sleeps until it has something to do rather than spinning
+	// the simulation thread on its ticks, the network thread on delayed messages, queued packets and polling RakNet
+	TickScheduler			m_scheduler;
+	TickScheduler			m_networkScheduler;
+	const uint64_t			TICK_MICROSECONDS = 16666;
+
+	// how often the network thread checks RakNet for packets, the most an ack or clock sync request waits on top of
+	// RakNet's own hand over, for clock sync that wait is asymmetric delay so it skews an estimate by up to half of it
+	const uint64_t			RECEIVE_POLL_MICROSECONDS = 1000;
+
+	// after a stall at most this many ticks are run in one go, the rest are dropped and the simulation falls behind
+	// rather than spending ever longer catching up, only the last of them is broadcast
+	unsigned int			m_maxCatchUpSteps;
+
+	// tick timing, printed every TIMING_REPORT_TICKS when asked for
+	// lateness is how late the first due tick of each batch started against its schedule
+	bool					m_reportTiming;
+	TickJitter				m_tickJitter;
+	const unsigned int		TIMING_REPORT_TICKS = 600;
+
+	struct LoopTiming {
+		uint64_t	ticks;
+		uint64_t	catchUpTicks;
+		uint64_t	droppedTicks;
+
+		// batches of ticks that took longer than a tick to run, and the longest
+		uint64_t	overruns;
+		uint64_t	worstBatchMicroseconds;
+
+		// time per phase on the simulation thread
+		uint64_t	simulateMicroseconds;
+		uint64_t	sendMicroseconds;
+	};
+	LoopTiming				m_timing;
+
+	// time per phase on the network thread
+	std::atomic<uint64_t>	m_sendQueuedMicroseconds;
+	std::atomic<uint64_t>	m_delayedMicroseconds;
+	std::atomic<uint64_t>	m_receiveMicroseconds;
+
+	void	printTiming();
 };
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "Server.h"
+#include <cstring>
+#include <cstdlib>
+
+// application main, uses command line options
+int main(int argc, char* argv[]) {
+
+	std::cout << "Use command line options: -count N -radius M -loss X -delay Y -range Z -precision P -chunk C -seed S -threads T -kernel K -interest I -bandwidth B -catchup U -allocations -timing" << std::endl;
+	std::cout << "N: entity count as int" << std::endl;
+	std::cout << "M: arena radius as float" << std::endl;
+	std::cout << "X: packetloss percentage as float" << std::endl;
+	std::cout << "Y: packet delay percentage as float" << std::endl;
+	std::cout << "Z: delay range in seconds as float" << std::endl;
+	std::cout << "P: largest position/velocity error sent to clients as float (default - 0.01)" << std::endl;
+	std::cout << "C: largest entity list packet in bytes as int, 0 sends each snapshot whole (default - 1200)" << std::endl;
+	std::cout << "S: random seed as int, the same seed replays the same run (default - 1)" << std::endl;
+	std::cout << "T: entity update worker threads as int (default - 1)" << std::endl;
+	std::cout << "K: entity update kernel, scalar, sse2 or avx2 (default - widest supported)" << std::endl;
+	std::cout << "I: interest radius around each client's view as float, 0 sends every entity every tick (default - 0)" << std::endl;
+	std::cout << "B: entity list bandwidth per client in kbps as float, 0 sends every entity every tick (default - 0)" << std::endl;
+	std::cout << "U: most ticks run at once to catch up after a stall as int, the rest are dropped (default - 4)" << std::endl;
+	std::cout << "-allocations: print how many heap allocations the simulation thread makes, needs a build with AIE_COUNT_ALLOCATIONS" << std::endl;
+	std::cout << "-timing: print tick lateness, catch-up and dropped ticks and time per phase" << std::endl << std::endl;
+
+	unsigned int entityCount = 100;
+	float radius = 50;
+	float packetlossPercentage = 10;
+	float delayPercentage = 10;
+	float delayRange = 1;
+	float precision = 0.01f;
+	unsigned int chunkBytes = 1200;
+	uint64_t seed = 1;
+	unsigned int threadCount = 1;
+	const char* kernel = nullptr;
+	float interestRadius = 0;
+	float bandwidthKbps = 0;
+	bool reportAllocations = false;
+	bool reportTiming = false;
+	unsigned int maxCatchUpSteps = 4;
+
+	for (int i = 0; i < argc; ++i) {
+		if (strcmp(argv[i], "-count") == 0) {
+			entityCount = (unsigned int)atoi(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-radius") == 0) {
+			radius = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-precision") == 0) {
+			precision = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-chunk") == 0) {
+			chunkBytes = (unsigned int)atoi(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-seed") == 0) {
+			seed = strtoull(argv[i + 1], nullptr, 10);
+		}
+		if (strcmp(argv[i], "-threads") == 0) {
+			threadCount = (unsigned int)atoi(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-loss") == 0) {
+			packetlossPercentage = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-delay") == 0) {
+			delayPercentage = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-range") == 0) {
+			delayRange = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-kernel") == 0) {
+			kernel = argv[i + 1];
+		}
+		if (strcmp(argv[i], "-interest") == 0) {
+			interestRadius = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-bandwidth") == 0) {
+			bandwidthKbps = (float)atof(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-allocations") == 0) {
+			reportAllocations = true;
+		}
+		if (strcmp(argv[i], "-timing") == 0) {
+			reportTiming = true;
+		}
+		if (strcmp(argv[i], "-catchup") == 0) {
+			maxCatchUpSteps = (unsigned int)atoi(argv[i + 1]);
+		}
+	}
+
+	// 0 sends each snapshot whole, anything else has to have room for at least one entity
+	unsigned int minimumChunkBytes = Server::minimumChunkBytes(radius, precision);
+	if (chunkBytes > 0 && chunkBytes < minimumChunkBytes) {
+		std::cout << "Needs a chunk of at least " << minimumChunkBytes << " bytes, or 0 to not split snapshots" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Entity Count: " << entityCount << std::endl;
+	std::cout << "Arena Radius: " << radius << std::endl;
+	std::cout << "Snapshot Precision: " << precision << std::endl;
+	std::cout << "Snapshot Chunk Bytes: " << chunkBytes << std::endl;
+	std::cout << "Random Seed: " << seed << std::endl;
+	std::cout << "Worker Threads: " << threadCount << std::endl;
+	std::cout << "Interest Radius: " << interestRadius << std::endl;
+	std::cout << "Bandwidth Per Client in kbps: " << bandwidthKbps << std::endl;
+	std::cout << "Max Catch-up Ticks: " << maxCatchUpSteps << std::endl;
+	std::cout << "Packet Loss Percentage: " << packetlossPercentage << std::endl;
+	std::cout << "Packet Delay Percentage: " << delayPercentage << std::endl;
+	std::cout << "Max Delay Time in Seconds: " << delayRange << std::endl << std::endl;
+
+	Server server(entityCount, radius, packetlossPercentage, delayPercentage, delayRange, precision, chunkBytes, seed, threadCount, kernel, interestRadius, bandwidthKbps, reportAllocations, reportTiming, maxCatchUpSteps);
+	server.run();
+	return 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <BitStream.h>
+
+class SharedPayloadPool;
+
+// one encoded packet, shared by every client it goes to and every delayed send of it
+// starts with a single reference and goes back to its pool when the last one is released
+class SharedPayload {
+public:
+
+	void	addReference() { m_references.fetch_add(1, std::memory_order_relaxed); }
+	void	release();
+
+	RakNet::BitStream	stream;
+
+private:
+
+	friend class SharedPayloadPool;
+
+	explicit SharedPayload(SharedPayloadPool* pool) : m_pool(pool), m_references(0) {}
+	~SharedPayload() {}
+
+	SharedPayloadPool*			m_pool;
+	std::atomic<unsigned int>	m_references;
+};
+
+// recycles payloads so their streams keep the buffers they grew to,
+// once a tick's worth have been made the server loop stops allocating them
+// when it runs dry it grows by half again, how many are in flight goes up and down with loss and
+// which baselines clients hold, so growing to each new high one at a time would keep allocating long after start up
+class SharedPayloadPool {
+public:
+
+	SharedPayloadPool() : m_payloadBits(0), m_total(0) {}
+	~SharedPayloadPool();
+
+	// an empty payload with one reference, with room for at least the payload size set below
+	SharedPayload*	acquire();
+
+	// the largest payload usually written, so a recycled payload grows to it once instead of
+	// whenever one that has only held small packets is handed a big one
+	void			setPayloadBits(unsigned int bits) { m_payloadBits = bits; }
+
+	unsigned int	freeCount() const { return (unsigned int)m_free.size(); }
+
+private:
+
+	friend class SharedPayload;
+
+	void	recycle(SharedPayload* payload);
+
+	SharedPayloadPool(const SharedPayloadPool&) = delete;
+	SharedPayloadPool& operator=(const SharedPayloadPool&) = delete;
+
+	// payloads can be released from another thread than the one encoding them
+	std::mutex					m_lock;
+	std::vector<SharedPayload*>	m_free;
+
+	unsigned int				m_payloadBits;
+
+	// every payload made, m_free is kept with room for all of them so recycling never reallocates
+	unsigned int				m_total;
+};
+
+inline void SharedPayload::release() {
+	if (m_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		m_pool->recycle(this);
+}
+
+inline SharedPayloadPool::~SharedPayloadPool() {
+	// every payload has to have been released by now
+	for (SharedPayload* payload : m_free)
+		delete payload;
+}
+
+inline SharedPayload* SharedPayloadPool::acquire() {
+	SharedPayload* payload = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if (!m_free.empty()) {
+			payload = m_free.back();
+			m_free.pop_back();
+		}
+	}
+	if (payload == nullptr) {
+		std::lock_guard<std::mutex> lock(m_lock);
+		unsigned int grow = m_total / 2 > 0 ? m_total / 2 : 1;
+		m_total += grow;
+		m_free.reserve(m_total);
+		for (unsigned int i = 1; i < grow; ++i) {
+			SharedPayload* spare = new SharedPayload(this);
+			if (m_payloadBits > 0)
+				spare->stream.AddBitsAndReallocate(m_payloadBits);
+			m_free.push_back(spare);
+		}
+		payload = new SharedPayload(this);
+	}
+
+	// reset keeps the stream's buffer, and growing it only reallocates if it is still smaller
+	payload->stream.Reset();
+	if (m_payloadBits > 0)
+		payload->stream.AddBitsAndReallocate(m_payloadBits);
+	payload->m_references.store(1, std::memory_order_relaxed);
+	return payload;
+}
+
+inline void SharedPayloadPool::recycle(SharedPayload* payload) {
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_free.push_back(payload);
+}
@@ -0,0 +1,349 @@
+#include "Snapshot.h"
+#include <RakNetTypes.h>
+#include <RakNetTime.h>
+
+// fewest bits whose steps over range are no wider than twice precision (error is half a step)
+static unsigned char bitsForRange(float range, float precision) {
+	double steps = range / (2.0 * precision);
+	unsigned char bits = 1;
+	while (bits < 24 && ((1u << bits) - 1) < steps)
+		++bits;
+	return bits;
+}
+
+static unsigned int quantize(float value, float minimum, float maximum, unsigned char bits) {
+	unsigned int maxValue = (1u << bits) - 1;
+	float t = (value - minimum) / (maximum - minimum);
+	if (t <= 0)
+		return 0;
+	if (t >= 1)
+		return maxValue;
+	return (unsigned int)(t * maxValue + 0.5f);
+}
+
+static float dequantize(unsigned int value, float minimum, float maximum, unsigned char bits) {
+	unsigned int maxValue = (1u << bits) - 1;
+	return minimum + (maximum - minimum) * (value / (float)maxValue);
+}
+
+void SnapshotFormat::setPrecision(float radius, float velocity, float precision) {
+	arenaRadius = radius;
+	maxVelocity = velocity;
+	positionBits = bitsForRange(radius * 2, precision);
+	velocityBits = bitsForRange(velocity * 2, precision);
+}
+
+unsigned int SnapshotFormat::quantizePosition(float value) const {
+	return quantize(value, -arenaRadius, arenaRadius, positionBits);
+}
+
+unsigned int SnapshotFormat::quantizeVelocity(float value) const {
+	return quantize(value, -maxVelocity, maxVelocity, velocityBits);
+}
+
+float SnapshotFormat::dequantizePosition(unsigned int value) const {
+	return dequantize(value, -arenaRadius, arenaRadius, positionBits);
+}
+
+float SnapshotFormat::dequantizeVelocity(unsigned int value) const {
+	return dequantize(value, -maxVelocity, maxVelocity, velocityBits);
+}
+
+void SnapshotFormat::write(RakNet::BitStream& stream) const {
+	stream.Write(arenaRadius);
+	stream.Write(maxVelocity);
+	stream.Write(positionBits);
+	stream.Write(velocityBits);
+}
+
+bool SnapshotFormat::read(RakNet::BitStream& stream) {
+	return stream.Read(arenaRadius) &&
+		stream.Read(maxVelocity) &&
+		stream.Read(positionBits) &&
+		stream.Read(velocityBits) &&
+		positionBits > 0 && positionBits <= 24 &&
+		velocityBits > 0 && velocityBits <= 24;
+}
+
+unsigned int SnapshotHeader::bits() const {
+	RakNet::BitStream stream;
+	write(stream);
+	return stream.GetNumberOfBitsUsed();
+}
+
+// a baseline is 1 to SNAPSHOT_HISTORY - 1 snapshots back
+static const unsigned char SNAPSHOT_BASELINE_AGE_BITS = 5;
+static_assert(SNAPSHOT_HISTORY - 2 < 1u << SNAPSHOT_BASELINE_AGE_BITS, "baseline age doesn't fit");
+
+void SnapshotHeader::write(RakNet::BitStream& stream) const {
+	stream.Write(sequence);
+	stream.Write(hasBaseline);
+	if (hasBaseline)
+		stream.WriteBitsFromIntegerRange(sequence - baselineSequence, 1u, SNAPSHOT_HISTORY - 1, SNAPSHOT_BASELINE_AGE_BITS);
+	stream.Write(chunkIndex);
+	if (!hasBaseline) {
+		stream.Write(totalEntities);
+		stream.Write(entitiesPerChunk);
+		format.write(stream);
+	}
+}
+
+bool SnapshotHeader::read(RakNet::BitStream& stream) {
+	if (!stream.Read(sequence) || !stream.Read(hasBaseline))
+		return false;
+	if (hasBaseline) {
+		unsigned int age;
+		if (!stream.ReadBitsFromIntegerRange(age, 1u, SNAPSHOT_HISTORY - 1, SNAPSHOT_BASELINE_AGE_BITS))
+			return false;
+		baselineSequence = sequence - age;
+	}
+	if (!stream.Read(chunkIndex))
+		return false;
+	return hasBaseline || (stream.Read(totalEntities) && stream.Read(entitiesPerChunk) && format.read(stream));
+}
+
+bool SnapshotHeader::placeChunk() {
+	if (entitiesPerChunk == 0)
+		return false;
+
+	unsigned int chunks = snapshotChunkCount(totalEntities, entitiesPerChunk);
+	if (chunkIndex >= chunks || chunks > 0xffff)
+		return false;
+	chunkCount = (unsigned short)chunks;
+	firstEntity = chunkIndex * entitiesPerChunk;
+	return true;
+}
+
+unsigned int snapshotChunkOverheadBits() {
+	// keyframe chunks have the bigger header, and a delta chunk is never bigger than the keyframe of its range
+	SnapshotHeader header = {};
+	header.hasBaseline = false;
+	return (sizeof(RakNet::MessageID) + sizeof(RakNet::Time)) * 8 + header.bits() + sizeof(unsigned int) * 8;
+}
+
+unsigned int snapshotMinimumChunkBytes(const SnapshotFormat& format) {
+	return (snapshotChunkOverheadBits() + format.entityBits() + 7) / 8;
+}
+
+unsigned int snapshotEntitiesPerChunk(const SnapshotFormat& format, unsigned int totalEntities, unsigned int chunkBytes) {
+	if (chunkBytes == 0)
+		return totalEntities > 0 ? totalEntities : 1;
+	return (chunkBytes * 8 - snapshotChunkOverheadBits()) / format.entityBits();
+}
+
+// small field changes are sent as a signed offset of SNAPSHOT_DELTA_BITS bits
+// fields no wider than that are always sent whole, without the flag saying which it is
+static const unsigned char SNAPSHOT_DELTA_BITS = 8;
+static const int SNAPSHOT_DELTA_RANGE = 1 << (SNAPSHOT_DELTA_BITS - 1);
+
+static bool deltaFits(unsigned int value, unsigned int base) {
+	int delta = (int)value - (int)base;
+	return delta >= -SNAPSHOT_DELTA_RANGE && delta < SNAPSHOT_DELTA_RANGE;
+}
+
+static void writeField(RakNet::BitStream& stream, unsigned int value, unsigned int base, unsigned char bits) {
+	if (bits <= SNAPSHOT_DELTA_BITS) {
+		stream.WriteBitsFromIntegerRange(value, 0u, (1u << bits) - 1, bits);
+	}
+	else if (deltaFits(value, base)) {
+		stream.Write1();
+		stream.WriteBitsFromIntegerRange((unsigned int)((int)value - (int)base + SNAPSHOT_DELTA_RANGE), 0u, (unsigned int)(SNAPSHOT_DELTA_RANGE * 2 - 1), SNAPSHOT_DELTA_BITS);
+	}
+	else {
+		stream.Write0();
+		stream.WriteBitsFromIntegerRange(value, 0u, (1u << bits) - 1, bits);
+	}
+}
+
+static bool readField(RakNet::BitStream& stream, unsigned int& value, unsigned int base, unsigned char bits) {
+	bool isDelta = false;
+	if (bits > SNAPSHOT_DELTA_BITS && !stream.Read(isDelta))
+		return false;
+	if (isDelta) {
+		unsigned int delta;
+		if (!stream.ReadBitsFromIntegerRange(delta, 0u, (unsigned int)(SNAPSHOT_DELTA_RANGE * 2 - 1), SNAPSHOT_DELTA_BITS))
+			return false;
+		value = base + delta - SNAPSHOT_DELTA_RANGE;
+		return value < (1u << bits);
+	}
+	return stream.ReadBitsFromIntegerRange(value, 0u, (1u << bits) - 1, bits);
+}
+
+// a changed field costs a bit to say so, unchanged fields cost one bit each
+static void writeChangedField(RakNet::BitStream& stream, unsigned int value, unsigned int base, unsigned char bits) {
+	stream.Write(value != base);
+	if (value != base)
+		writeField(stream, value, base, bits);
+}
+
+static bool readChangedField(RakNet::BitStream& stream, unsigned int& value, unsigned int base, unsigned char bits) {
+	bool changed;
+	if (!stream.Read(changed))
+		return false;
+	if (!changed) {
+		value = base;
+		return true;
+	}
+	return readField(stream, value, base, bits);
+}
+
+void writeSnapshotEntities(RakNet::BitStream& stream, const SnapshotFormat& format, const QuantizedEntity* entities, const QuantizedEntity* baseline, const unsigned char* updated, unsigned int count) {
+
+	unsigned int maxPosition = (1u << format.positionBits) - 1;
+	unsigned int maxVelocity = (1u << format.velocityBits) - 1;
+
+	stream.Write(count);
+	for (unsigned int i = 0; i < count; ++i) {
+		const QuantizedEntity& e = entities[i];
+
+		// keyframe, every field in full
+		if (baseline == nullptr) {
+			stream.WriteBitsFromIntegerRange(e.positionX, 0u, maxPosition, format.positionBits);
+			stream.WriteBitsFromIntegerRange(e.positionY, 0u, maxPosition, format.positionBits);
+			stream.WriteBitsFromIntegerRange(e.velocityX, 0u, maxVelocity, format.velocityBits);
+			stream.WriteBitsFromIntegerRange(e.velocityY, 0u, maxVelocity, format.velocityBits);
+			stream.Write(e.teleported);
+			continue;
+		}
+
+		const QuantizedEntity& b = baseline[i];
+		bool changed = e.positionX != b.positionX || e.positionY != b.positionY ||
+			e.velocityX != b.velocityX || e.velocityY != b.velocityY ||
+			e.teleported != b.teleported;
+		stream.Write(changed);
+		if (!changed) {
+			stream.Write(updated == nullptr || updated[i] != 0);
+			continue;
+		}
+
+		writeChangedField(stream, e.positionX, b.positionX, format.positionBits);
+		writeChangedField(stream, e.positionY, b.positionY, format.positionBits);
+		writeChangedField(stream, e.velocityX, b.velocityX, format.velocityBits);
+		writeChangedField(stream, e.velocityY, b.velocityY, format.velocityBits);
+		stream.Write(e.teleported);
+	}
+}
+
+bool readSnapshotEntities(RakNet::BitStream& stream, const SnapshotFormat& format, const QuantizedEntity* baseline, QuantizedEntity* entities, unsigned char* updated, unsigned int maxCount, unsigned int& count) {
+
+	unsigned int maxPosition = (1u << format.positionBits) - 1;
+	unsigned int maxVelocity = (1u << format.velocityBits) - 1;
+
+	count = 0;
+	if (!stream.Read(count))
+		return false;
+
+	// refuse counts the packet can't possibly hold, or that there isn't room for
+	unsigned int minimumEntityBits = baseline != nullptr ? SNAPSHOT_UNCHANGED_BITS : format.entityBits();
+	if ((unsigned long long)count * minimumEntityBits > stream.GetNumberOfUnreadBits())
+		return false;
+	if (count > maxCount)
+		return false;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		QuantizedEntity& e = entities[i];
+		if (updated != nullptr)
+			updated[i] = 1;
+
+		if (baseline == nullptr) {
+			if (!stream.ReadBitsFromIntegerRange(e.positionX, 0u, maxPosition, format.positionBits) ||
+				!stream.ReadBitsFromIntegerRange(e.positionY, 0u, maxPosition, format.positionBits) ||
+				!stream.ReadBitsFromIntegerRange(e.velocityX, 0u, maxVelocity, format.velocityBits) ||
+				!stream.ReadBitsFromIntegerRange(e.velocityY, 0u, maxVelocity, format.velocityBits) ||
+				!stream.Read(e.teleported))
+				return false;
+			continue;
+		}
+
+		// each field is read before it is written, so baseline and entities may be the same array
+		const QuantizedEntity& b = baseline[i];
+		bool changed;
+		if (!stream.Read(changed))
+			return false;
+		if (!changed) {
+			bool sent;
+			if (!stream.Read(sent))
+				return false;
+			if (updated != nullptr)
+				updated[i] = sent;
+			e = b;
+			continue;
+		}
+
+		if (!readChangedField(stream, e.positionX, b.positionX, format.positionBits) ||
+			!readChangedField(stream, e.positionY, b.positionY, format.positionBits) ||
+			!readChangedField(stream, e.velocityX, b.velocityX, format.velocityBits) ||
+			!readChangedField(stream, e.velocityY, b.velocityY, format.velocityBits) ||
+			!stream.Read(e.teleported))
+			return false;
+	}
+	return true;
+}
+
+static unsigned int fieldBits(unsigned int value, unsigned int base, unsigned char bits) {
+	if (value == base)
+		return 1;
+	if (bits <= SNAPSHOT_DELTA_BITS)
+		return 1 + bits;
+	if (deltaFits(value, base))
+		return 2 + SNAPSHOT_DELTA_BITS;
+	return 2 + bits;
+}
+
+unsigned int snapshotEntityBits(const SnapshotFormat& format, const QuantizedEntity& e, const QuantizedEntity* baseline) {
+
+	if (baseline == nullptr)
+		return format.entityBits();
+
+	const QuantizedEntity& b = *baseline;
+	if (e.positionX == b.positionX && e.positionY == b.positionY &&
+		e.velocityX == b.velocityX && e.velocityY == b.velocityY &&
+		e.teleported == b.teleported)
+		return SNAPSHOT_UNCHANGED_BITS;
+
+	return 2 +
+		fieldBits(e.positionX, b.positionX, format.positionBits) +
+		fieldBits(e.positionY, b.positionY, format.positionBits) +
+		fieldBits(e.velocityX, b.velocityX, format.velocityBits) +
+		fieldBits(e.velocityY, b.velocityY, format.velocityBits);
+}
+
+SnapshotHistory::SnapshotHistory() {
+	clear();
+}
+
+std::vector<QuantizedEntity>& SnapshotHistory::prepare(unsigned int sequence) {
+	Entry& entry = m_entries[sequence % SNAPSHOT_HISTORY];
+	entry.sequence = sequence;
+	entry.valid = false;
+	return entry.entities;
+}
+
+void SnapshotHistory::commit(unsigned int sequence) {
+	Entry& entry = m_entries[sequence % SNAPSHOT_HISTORY];
+	if (entry.sequence == sequence)
+		entry.valid = true;
+}
+
+const std::vector<QuantizedEntity>* SnapshotHistory::find(unsigned int sequence) const {
+	const Entry& entry = m_entries[sequence % SNAPSHOT_HISTORY];
+	if (!entry.valid || entry.sequence != sequence)
+		return nullptr;
+	return &entry.entities;
+}
+
+void SnapshotHistory::clear() {
+	for (auto& entry : m_entries) {
+		entry.sequence = 0;
+		entry.valid = false;
+	}
+}
+
+void dequantizeEntity(const SnapshotFormat& format, const QuantizedEntity& in, unsigned int id, AIEntity& out) {
+	out.id = id;
+	out.position.x = format.dequantizePosition(in.positionX);
+	out.position.y = format.dequantizePosition(in.positionY);
+	out.velocity.x = format.dequantizeVelocity(in.velocityX);
+	out.velocity.y = format.dequantizeVelocity(in.velocityY);
+	out.teleported = in.teleported;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <vector>
+#include <BitStream.h>
+
+#include "../src/AIEntity.h"
+
+// how many past snapshots the server and client keep as delta baselines, about half a second at 60hz
+static const unsigned int SNAPSHOT_HISTORY = 32;
+
+// true if sequence a was sent after sequence b, allowing for wrap around
+inline bool sequenceGreater(unsigned int a, unsigned int b)
+{
+	return (int)(a - b) > 0;
+}
+
+// quantisation settings for an entity snapshot
+// written at the start of every ID_ENTITY_LIST so clients can decode it without any other setup
+struct SnapshotFormat
+{
+	float			arenaRadius;
+	float			maxVelocity;
+	unsigned char	positionBits;
+	unsigned char	velocityBits;
+
+	// picks the fewest bits that keep positions and velocities within precision of the real value
+	void			setPrecision(float radius, float velocity, float precision);
+
+	unsigned int	quantizePosition(float value) const;
+	unsigned int	quantizeVelocity(float value) const;
+	float			dequantizePosition(unsigned int value) const;
+	float			dequantizeVelocity(unsigned int value) const;
+
+	// bits used by one entity in the stream
+	unsigned int	entityBits() const { return positionBits * 2 + velocityBits * 2 + 1; }
+
+	void			write(RakNet::BitStream& stream) const;
+	bool			read(RakNet::BitStream& stream);
+};
+
+// an AIEntity after quantisation, the id is implied by its index in the snapshot
+struct QuantizedEntity
+{
+	unsigned int	positionX;
+	unsigned int	positionY;
+	unsigned int	velocityX;
+	unsigned int	velocityY;
+	bool			teleported;
+};
+
+// chunks in a snapshot of totalEntities split into ranges of entitiesPerChunk, an empty snapshot still sends one
+inline unsigned int snapshotChunkCount(unsigned int totalEntities, unsigned int entitiesPerChunk)
+{
+	return totalEntities > 0 ? (totalEntities + entitiesPerChunk - 1) / entitiesPerChunk : 1;
+}
+
+// everything in an ID_ENTITY_LIST between the timestamp and the entities
+// each snapshot is split into chunks covering fixed ranges of entitiesPerChunk entities, one chunk per packet,
+// and each chunk is decoded and acknowledged on its own, so a lost packet only costs its range a baseline
+struct SnapshotHeader
+{
+	unsigned int	sequence;
+
+	// when set the entities are deltas against the same range of the snapshot with baselineSequence,
+	// otherwise this chunk is a keyframe that decodes on its own
+	// sent as how many snapshots back the baseline is, it is always inside the history
+	bool			hasBaseline;
+	unsigned int	baselineSequence;
+
+	unsigned short	chunkIndex;
+
+	// only sent with keyframe chunks, a delta's range is the same as its baseline's so the client already has them
+	unsigned int	totalEntities;
+	unsigned int	entitiesPerChunk;
+	SnapshotFormat	format;
+
+	// not sent, worked out from the rest by placeChunk
+	// this packet holds entities [firstEntity, firstEntity + entity count) of totalEntities
+	unsigned short	chunkCount;
+	unsigned int	firstEntity;
+
+	// size of the header once written
+	unsigned int	bits() const;
+
+	void			write(RakNet::BitStream& stream) const;
+
+	// a delta chunk's layout is left as it was, for the caller to fill in from the last keyframe chunk
+	bool			read(RakNet::BitStream& stream);
+
+	// works out chunkCount and firstEntity from the layout, false if the chunk isn't in it
+	bool			placeChunk();
+};
+
+// writes / reads the entity count followed by the packed entities
+// with a baseline, unchanged entities cost two bits and changed fields are sent as small offsets where they fit
+// updated is 0 for entities the server left out this tick, which carry over the baseline's value and so encode as unchanged,
+// the second bit of an unchanged entity says which it was so the client can tell a stale value from one that didn't move
+// nullptr writes every entity as updated, and reading into a nullptr updated skips the flags
+// reading into the baseline's own storage is allowed, so a snapshot can be updated in place
+void	writeSnapshotEntities(RakNet::BitStream& stream, const SnapshotFormat& format, const QuantizedEntity* entities, const QuantizedEntity* baseline, const unsigned char* updated, unsigned int count);
+bool	readSnapshotEntities(RakNet::BitStream& stream, const SnapshotFormat& format, const QuantizedEntity* baseline, QuantizedEntity* entities, unsigned char* updated, unsigned int maxCount, unsigned int& count);
+
+// bits of an ID_ENTITY_LIST packet that aren't entities: the message id, timestamp, the largest header and the entity count
+unsigned int	snapshotChunkOverheadBits();
+
+// the smallest chunk that holds one keyframe entity, every chunk is sized to hold its whole range as a keyframe
+unsigned int	snapshotMinimumChunkBytes(const SnapshotFormat& format);
+
+// entities in each chunk's range when packets are at most chunkBytes, 0 keeps every entity in one chunk
+// chunkBytes must be 0 or at least snapshotMinimumChunkBytes
+unsigned int	snapshotEntitiesPerChunk(const SnapshotFormat& format, unsigned int totalEntities, unsigned int chunkBytes);
+
+// bits writeSnapshotEntities uses for one entity, an entity left out costs SNAPSHOT_UNCHANGED_BITS
+static const unsigned int SNAPSHOT_UNCHANGED_BITS = 2;
+unsigned int	snapshotEntityBits(const SnapshotFormat& format, const QuantizedEntity& entity, const QuantizedEntity* baseline);
+
+// the last SNAPSHOT_HISTORY snapshots, looked up by sequence number
+class SnapshotHistory {
+public:
+
+	SnapshotHistory();
+
+	// returns the storage for a snapshot, replacing whichever one shared its slot
+	// the snapshot can't be found until it is committed
+	std::vector<QuantizedEntity>&		prepare(unsigned int sequence);
+	void								commit(unsigned int sequence);
+
+	// nullptr if the snapshot was never committed or has since been replaced
+	const std::vector<QuantizedEntity>*	find(unsigned int sequence) const;
+
+	void								clear();
+
+private:
+
+	struct Entry {
+		unsigned int					sequence;
+		bool							valid;
+		std::vector<QuantizedEntity>	entities;
+	};
+	Entry	m_entries[SNAPSHOT_HISTORY];
+};
+
+// converts back to the AIEntity layout the client simulates with
+void	dequantizeEntity(const SnapshotFormat& format, const QuantizedEntity& in, unsigned int id, AIEntity& out);
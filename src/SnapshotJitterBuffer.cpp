@@ -0,0 +1,217 @@
+#include "SnapshotJitterBuffer.h"
+#include <cmath>
+#include <algorithm>
+
+SnapshotJitterBuffer::SnapshotJitterBuffer()
+	: m_maxDelay(250) {
+	clear();
+}
+
+void SnapshotJitterBuffer::clear() {
+	m_count = 0;
+	m_hasArrival = false;
+	m_lastSequence = 0;
+	m_lastTransit = 0;
+	m_lastTime = 0;
+	m_jitter = 0;
+	m_interval = 1000.0 / 60;
+	m_delay = 0;
+	m_renderTime = 0;
+	m_started = false;
+	m_lateSnapshots = 0;
+	m_coalescedChunks = 0;
+	m_extrapolatedEntities = 0;
+
+	// a new connection starts its sequences again, so old stamps could match
+	for (Frame& frame : m_frames)
+		frame.receivedSequence.clear();
+}
+
+void SnapshotJitterBuffer::insert(const SnapshotHeader& header, RakNet::Time timestamp, double arrivalTime, const QuantizedEntity* entities,
+	const unsigned char* updated, unsigned int count) {
+
+	unsigned int sequence = header.sequence;
+	double time = (double)timestamp;
+
+	// arrivals are measured by each snapshot's first chunk, even if it turns out too late to draw
+	if (header.chunkIndex == 0) {
+		measureArrival(sequence, time, arrivalTime);
+		if (m_started && time < m_renderTime)
+			++m_lateSnapshots;
+	}
+
+	// after a delay burst only the newest of the snapshots that came in together is worth decoding
+	if (m_started && time < m_renderTime && hasNewerDrawnFrame(sequence)) {
+		++m_coalescedChunks;
+		return;
+	}
+
+	Frame* frame = findFrame(sequence, time, header.totalEntities);
+	if (frame == nullptr)
+		return;
+
+	unsigned int first = header.firstEntity;
+	unsigned int last = std::min(first + count, (unsigned int)frame->entities.size());
+	for (unsigned int i = first; i < last; ++i) {
+		// a carried over value would interpolate between two copies of the same stale position,
+		// unstamped the sample looks past this frame and extrapolates if nothing newer has the entity
+		if (updated != nullptr && !updated[i - first])
+			continue;
+		dequantizeEntity(header.format, entities[i - first], i, frame->entities[i]);
+		frame->receivedSequence[i] = sequence;
+	}
+}
+
+bool SnapshotJitterBuffer::hasNewerDrawnFrame(unsigned int sequence) const {
+	for (unsigned int k = 0; k < m_count; ++k) {
+		const Frame& frame = m_frames[m_order[k]];
+		if (frame.time <= m_renderTime && sequenceGreater(frame.sequence, sequence))
+			return true;
+	}
+	return false;
+}
+
+SnapshotJitterBuffer::Frame* SnapshotJitterBuffer::findFrame(unsigned int sequence, double time, unsigned int totalEntities) {
+
+	for (unsigned int k = 0; k < m_count; ++k) {
+		if (m_frames[m_order[k]].sequence == sequence)
+			return &m_frames[m_order[k]];
+	}
+
+	// frames are only ever removed by dropping the oldest once full, so until then slots [0, m_count) are the ones in use
+	unsigned int slot = m_count;
+	if (m_count == FRAMES) {
+		if (sequenceGreater(m_frames[m_order[0]].sequence, sequence))
+			return nullptr;
+		slot = m_order[0];
+		for (unsigned int k = 1; k < m_count; ++k)
+			m_order[k - 1] = m_order[k];
+		--m_count;
+	}
+
+	// sorted insert, a snapshot nearly always lands at the end
+	unsigned int position = m_count;
+	while (position > 0 && sequenceGreater(m_frames[m_order[position - 1]].sequence, sequence)) {
+		m_order[position] = m_order[position - 1];
+		--position;
+	}
+	m_order[position] = slot;
+	++m_count;
+
+	// nothing is cleared, entities left over from the slot's last snapshot carry an older sequence
+	// resizing only happens when the entity count changes, a full buffer stops allocating
+	Frame& frame = m_frames[slot];
+	frame.sequence = sequence;
+	frame.time = time;
+	if (frame.entities.size() != totalEntities) {
+		frame.entities.resize(totalEntities);
+		frame.receivedSequence.resize(totalEntities, sequence - 1);
+	}
+	return &frame;
+}
+
+void SnapshotJitterBuffer::measureArrival(unsigned int sequence, double time, double arrivalTime) {
+
+	// the clocks' offset cancels out, only the change in transit time between arrivals is jitter
+	double transit = arrivalTime - time;
+	if (!m_hasArrival) {
+		m_hasArrival = true;
+		m_lastSequence = sequence;
+		m_lastTime = time;
+		m_lastTransit = transit;
+		return;
+	}
+
+	double deviation = std::min(std::fabs(transit - m_lastTransit), MAX_JITTER_SAMPLE);
+	m_jitter += (deviation - m_jitter) / 16;
+	m_lastTransit = transit;
+
+	// the server skips sequences for clients it has nothing for, so measure per sequence
+	if (sequenceGreater(sequence, m_lastSequence)) {
+		double interval = (time - m_lastTime) / (double)(sequence - m_lastSequence);
+		if (interval > 0)
+			m_interval += (interval - m_interval) / 16;
+		m_lastSequence = sequence;
+		m_lastTime = time;
+	}
+}
+
+void SnapshotJitterBuffer::sample(double localTime, float deltaTime, std::vector<AIEntity>& entities) {
+
+	m_extrapolatedEntities = 0;
+	if (m_count == 0)
+		return;
+
+	double target = std::min(DELAY_INTERVALS * m_interval + DELAY_JITTERS * m_jitter, m_maxDelay);
+	if (!m_started) {
+		m_delay = target;
+		m_started = true;
+	}
+	else {
+		double step = deltaTime * 1000.0 * DELAY_ADJUST_RATE;
+		m_delay += std::max(-step, std::min(target - m_delay, step));
+	}
+
+	double t = localTime - m_delay;
+	m_renderTime = t;
+
+	const Frame& newest = m_frames[m_order[m_count - 1]];
+	unsigned int total = (unsigned int)newest.entities.size();
+	entities.resize(total);
+
+	// the newest frame at or before the render time, frames after it are newer
+	int before = -1;
+	while (before + 1 < (int)m_count && m_frames[m_order[before + 1]].time <= t)
+		++before;
+
+	for (unsigned int i = 0; i < total; ++i) {
+
+		// the nearest frames either side that carried this entity, chunks can be lost on their own
+		const Frame* from = nullptr;
+		for (int k = before; k >= 0 && from == nullptr; --k) {
+			const Frame& frame = m_frames[m_order[k]];
+			if (i < frame.receivedSequence.size() && frame.receivedSequence[i] == frame.sequence)
+				from = &frame;
+		}
+		const Frame* to = nullptr;
+		for (unsigned int k = before + 1; k < m_count && to == nullptr; ++k) {
+			const Frame& frame = m_frames[m_order[k]];
+			if (i < frame.receivedSequence.size() && frame.receivedSequence[i] == frame.sequence)
+				to = &frame;
+		}
+
+		AIEntity& out = entities[i];
+		if (from != nullptr && to != nullptr) {
+			const AIEntity& a = from->entities[i];
+			const AIEntity& b = to->entities[i];
+
+			// a teleport is a jump, not a path, so hold until the render time reaches it
+			if (b.teleported)
+				out = a;
+			else {
+				float alpha = to->time > from->time ? (float)((t - from->time) / (to->time - from->time)) : 1.0f;
+				out.position.x = a.position.x + (b.position.x - a.position.x) * alpha;
+				out.position.y = a.position.y + (b.position.y - a.position.y) * alpha;
+				out.velocity.x = a.velocity.x + (b.velocity.x - a.velocity.x) * alpha;
+				out.velocity.y = a.velocity.y + (b.velocity.y - a.velocity.y) * alpha;
+
+				// still flagged just after a teleport, so nothing downstream blends across the jump
+				out.teleported = a.teleported;
+			}
+		}
+		else if (from != nullptr) {
+			// run dry, carry on along the last velocity for a while then hold
+			const AIEntity& a = from->entities[i];
+			float ahead = (float)(std::min(t - from->time, MAX_EXTRAPOLATION) / 1000.0);
+			out = a;
+			out.position.x += a.velocity.x * ahead;
+			out.position.y += a.velocity.y * ahead;
+			++m_extrapolatedEntities;
+		}
+		// rendering from before the oldest snapshot kept
+		else if (to != nullptr)
+			out = to->entities[i];
+
+		out.id = i;
+	}
+}
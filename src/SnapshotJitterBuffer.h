@@ -0,0 +1,109 @@
+#pragma once
+#include <vector>
+#include <RakNetTime.h>
+
+#include "../src/AIEntity.h"
+#include "../src/Snapshot.h"
+
+// recent snapshots ordered by sequence, so entities are drawn a little in the past
+// with a snapshot either side of the render time to interpolate between
+// the delay follows the measured arrival jitter, and extrapolation is only used when the buffer runs dry
+// times are milliseconds on the server's clock, arrivals and the render time are estimated with ClockSync
+class SnapshotJitterBuffer {
+public:
+
+	SnapshotJitterBuffer();
+
+	void	clear();
+
+	// a decoded chunk with count entities from header.firstEntity, stamped with timestamp and arriving at arrivalTime
+	// only the chunk's entities are written, a new frame reuses the oldest one's arrays without clearing them
+	// entities whose updated flag is 0 only carry an older snapshot's value and are left out, as if their chunk was lost,
+	// nullptr takes every entity
+	void	insert(const SnapshotHeader& header, RakNet::Time timestamp, double arrivalTime, const QuantizedEntity* entities,
+				const unsigned char* updated, unsigned int count);
+
+	// every entity's state at localTime - delay(), eases the delay toward its target by at most a fraction of deltaTime
+	void	sample(double localTime, float deltaTime, std::vector<AIEntity>& entities);
+
+	double	delay() const			{ return m_delay; }
+	double	jitter() const			{ return m_jitter; }
+
+	// the time entities were last sampled at
+	double	renderTime() const		{ return m_renderTime; }
+
+	// caps the delay, 0 always extrapolates from the newest snapshot like plain dead reckoning
+	void	setMaxDelay(double milliseconds)	{ m_maxDelay = milliseconds; }
+
+	// snapshots whose first chunk came in after the render time had passed them
+	unsigned int	lateSnapshots() const			{ return m_lateSnapshots; }
+
+	// chunks never decoded, a newer snapshot was already behind the render time when they arrived
+	unsigned int	coalescedChunks() const			{ return m_coalescedChunks; }
+
+	// entities the last sample had to extrapolate or hold, nothing newer had them
+	unsigned int	extrapolatedEntities() const	{ return m_extrapolatedEntities; }
+
+	// a little over half a second of 60hz snapshots, the delay must stay well inside this
+	static const unsigned int	FRAMES = 32;
+
+private:
+
+	struct Frame {
+		unsigned int				sequence;
+		double						time;
+		std::vector<AIEntity>		entities;
+
+		// per entity, the sequence of the last frame in this slot to carry it, equal to sequence if this one did
+		// so a reused frame never needs clearing
+		std::vector<unsigned int>	receivedSequence;
+	};
+
+	// the frame holding sequence, making room by dropping the oldest, null if it is older than everything kept
+	Frame*	findFrame(unsigned int sequence, double time, unsigned int totalEntities);
+
+	// true if a snapshot newer than sequence is already at or behind the render time, so sequence will never be drawn
+	bool	hasNewerDrawnFrame(unsigned int sequence) const;
+
+	// updates the jitter and snapshot interval estimates with a snapshot's first chunk
+	void	measureArrival(unsigned int sequence, double time, double arrivalTime);
+
+	Frame			m_frames[FRAMES];
+
+	// indices of the frames in use, oldest sequence first
+	unsigned int	m_order[FRAMES];
+	unsigned int	m_count;
+
+	// the newest snapshot's arrival, for the jitter estimate
+	bool			m_hasArrival;
+	unsigned int	m_lastSequence;
+	double			m_lastTransit;
+	double			m_lastTime;
+
+	// mean deviation in transit time between consecutive snapshots (RFC 3550), and the server's snapshot interval
+	double			m_jitter;
+	double			m_interval;
+
+	// how far behind the newest data entities are drawn, and the last render time
+	double			m_delay;
+	double			m_renderTime;
+	bool			m_started;
+
+	unsigned int	m_lateSnapshots;
+	unsigned int	m_coalescedChunks;
+	unsigned int	m_extrapolatedEntities;
+
+	// delay = intervals of snapshots plus deviations of jitter, up to m_maxDelay
+	double			m_maxDelay;
+	const double	DELAY_INTERVALS = 2;
+	const double	DELAY_JITTERS = 3;
+
+	// the delay changes by at most this fraction of real time, so entities speed up or slow down slightly rather than jump
+	const double	DELAY_ADJUST_RATE = 0.1;
+
+	// a single delayed packet counts for at most this much jitter, the interpolation covers a lost or very late snapshot anyway
+	const double	MAX_JITTER_SAMPLE = 100;
+
+	// entities with nothing newer are extrapolated along their velocity for up to this long, then held
+	const double	MAX_EXTRAPOLATION = 250;
+};
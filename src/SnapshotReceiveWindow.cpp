@@ -0,0 +1,115 @@
+#include "SnapshotReceiveWindow.h"
+#include <cstring>
+
+SnapshotReceiveWindow::SnapshotReceiveWindow() {
+	clear();
+}
+
+void SnapshotReceiveWindow::clear() {
+	for (Slot& slot : m_slots) {
+		slot.sequence = 0;
+		slot.valid = false;
+	}
+	m_started = false;
+	m_first = 0;
+	m_latest = 0;
+	m_latestChunkCount = 1;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+SnapshotReceiveWindow::Slot& SnapshotReceiveWindow::startSlot(unsigned int sequence, unsigned int chunkCount) {
+	Slot& slot = m_slots[sequence % SNAPSHOT_HISTORY];
+	slot.sequence = sequence;
+	slot.valid = true;
+	slot.chunksReceived = 0;
+	slot.chunkReceived.assign(chunkCount, 0);
+	return slot;
+}
+
+void SnapshotReceiveWindow::retire(unsigned int sequence) {
+
+	// nothing before the first snapshot we saw was ever meant for us
+	if (sequenceGreater(m_first, sequence))
+		return;
+
+	const Slot& slot = m_slots[sequence % SNAPSHOT_HISTORY];
+	if (slot.valid && slot.sequence == sequence) {
+		m_stats.expectedPackets += slot.chunkReceived.size();
+		m_stats.lostPackets += slot.chunkReceived.size() - slot.chunksReceived;
+	}
+	else {
+		m_stats.expectedPackets += m_latestChunkCount;
+		m_stats.lostPackets += m_latestChunkCount;
+		++m_stats.lostSnapshots;
+	}
+}
+
+SnapshotReceiveWindow::Arrival SnapshotReceiveWindow::classify(const SnapshotHeader& header) {
+
+	unsigned int sequence = header.sequence;
+	Arrival arrival;
+
+	if (!m_started) {
+		m_started = true;
+		m_first = sequence;
+		m_latest = sequence;
+		startSlot(sequence, header.chunkCount);
+		arrival = ARRIVAL_IN_ORDER;
+	}
+	else if (sequenceGreater(sequence, m_latest)) {
+
+		// the window moves up to sequence, settling the snapshots that fall out of it
+		unsigned int ahead = sequence - m_latest;
+		unsigned int leaving = ahead < SNAPSHOT_HISTORY ? ahead : SNAPSHOT_HISTORY;
+		for (unsigned int i = 0; i < leaving; ++i)
+			retire(m_latest - (SNAPSHOT_HISTORY - 1) + i);
+
+		// jumped so far that some snapshots were never inside the window at all
+		if (ahead > SNAPSHOT_HISTORY) {
+			unsigned int never = ahead - SNAPSHOT_HISTORY;
+			m_stats.expectedPackets += (unsigned long long)never * m_latestChunkCount;
+			m_stats.lostPackets += (unsigned long long)never * m_latestChunkCount;
+			m_stats.lostSnapshots += never;
+		}
+
+		m_latest = sequence;
+		startSlot(sequence, header.chunkCount);
+		if (ahead == 1)
+			arrival = ARRIVAL_IN_ORDER;
+		else {
+			arrival = ARRIVAL_GAP;
+			m_stats.skippedSnapshots += ahead - 1;
+		}
+	}
+	else {
+		unsigned int behind = m_latest - sequence;
+		if (behind >= SNAPSHOT_HISTORY) {
+			++m_stats.stale;
+			return ARRIVAL_STALE;
+		}
+
+		// the first chunk to arrive of a snapshot that was skipped
+		Slot& slot = m_slots[sequence % SNAPSHOT_HISTORY];
+		if (!slot.valid || slot.sequence != sequence)
+			startSlot(sequence, header.chunkCount);
+		arrival = behind == 0 ? ARRIVAL_IN_ORDER : ARRIVAL_LATE;
+	}
+
+	Slot& slot = m_slots[sequence % SNAPSHOT_HISTORY];
+	if (header.chunkIndex >= slot.chunkReceived.size() || slot.chunkReceived[header.chunkIndex]) {
+		++m_stats.duplicates;
+		return ARRIVAL_DUPLICATE;
+	}
+	slot.chunkReceived[header.chunkIndex] = 1;
+	++slot.chunksReceived;
+	if (sequence == m_latest)
+		m_latestChunkCount = header.chunkCount;
+
+	if (arrival == ARRIVAL_IN_ORDER)
+		++m_stats.inOrder;
+	else if (arrival == ARRIVAL_LATE)
+		++m_stats.late;
+	else
+		++m_stats.gaps;
+	return arrival;
+}
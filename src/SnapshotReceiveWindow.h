@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+
+#include "../src/Snapshot.h"
+
+// counts of how entity list packets arrived on one connection
+struct SnapshotReceiveStats
+{
+	unsigned long long	inOrder;			// the next snapshot, or more chunks of the newest
+	unsigned long long	late;				// an older snapshot still inside the window, decoded if it can be
+	unsigned long long	stale;				// older than the window, rejected
+	unsigned long long	duplicates;			// a chunk already received
+	unsigned long long	gaps;				// jumped ahead of the next snapshot
+	unsigned long long	skippedSnapshots;	// snapshots jumped over, some of them turn up late
+
+	// settled once a snapshot leaves the window, so late packets are never counted as lost
+	// a snapshot nothing arrived for is counted with the chunk count of the newest one
+	unsigned long long	expectedPackets;
+	unsigned long long	lostPackets;
+	unsigned long long	lostSnapshots;
+
+	// packet loss as a percentage, comparable with the server's -loss
+	float	packetLossPercentage() const	{ return expectedPackets > 0 ? 100.0f * lostPackets / expectedPackets : 0.0f; }
+};
+
+// classifies each entity list chunk by its snapshot sequence before anything is decoded
+// remembers which chunks of the last SNAPSHOT_HISTORY snapshots arrived, anything older could never be decoded
+class SnapshotReceiveWindow {
+public:
+
+	enum Arrival {
+		ARRIVAL_IN_ORDER,
+		ARRIVAL_LATE,
+		ARRIVAL_STALE,
+		ARRIVAL_DUPLICATE,
+		ARRIVAL_GAP,
+	};
+
+	SnapshotReceiveWindow();
+
+	void	clear();
+
+	// header must already be checked, chunkIndex < chunkCount
+	Arrival	classify(const SnapshotHeader& header);
+
+	bool			hasSequence() const		{ return m_started; }
+	unsigned int	latestSequence() const	{ return m_latest; }
+
+	const SnapshotReceiveStats&	stats() const	{ return m_stats; }
+
+private:
+
+	struct Slot {
+		unsigned int				sequence;
+		bool						valid;
+		unsigned int				chunksReceived;
+		std::vector<unsigned char>	chunkReceived;
+	};
+
+	Slot&	startSlot(unsigned int sequence, unsigned int chunkCount);
+
+	// a snapshot leaving the window, its missing chunks are now lost
+	void	retire(unsigned int sequence);
+
+	Slot					m_slots[SNAPSHOT_HISTORY];
+	bool					m_started;
+	unsigned int			m_first;
+	unsigned int			m_latest;
+	unsigned int			m_latestChunkCount;
+	SnapshotReceiveStats	m_stats;
+};
@@ -0,0 +1,116 @@
+#include "SnapshotReceiver.h"
+
+SnapshotReceiver::SnapshotReceiver() {
+	clear();
+}
+
+void SnapshotReceiver::clear() {
+	for (auto& slot : m_slots) {
+		slot.sequence = 0;
+		slot.valid = false;
+	}
+	m_hasLayout = false;
+	m_totalEntities = 0;
+	m_entitiesPerChunk = 0;
+	m_window.clear();
+	m_arrival = SnapshotReceiveWindow::ARRIVAL_IN_ORDER;
+	m_chunkEntities = nullptr;
+	m_chunkEntityCount = 0;
+	m_completedSnapshot = false;
+}
+
+SnapshotReceiver::Result SnapshotReceiver::receivePacket(const unsigned char* data, unsigned int length, RakNet::Time& timestamp) {
+	RakNet::BitStream stream((unsigned char*)data, length, false);
+	stream.IgnoreBytes(sizeof(RakNet::MessageID)); // Ignore the ID_ENTITY_LIST message.
+	if (!stream.Read(timestamp))
+		return SNAPSHOT_MALFORMED;
+	return receive(stream);
+}
+
+void SnapshotReceiver::writeAck(RakNet::BitStream& stream) const {
+	stream.Write((RakNet::MessageID)ID_SNAPSHOT_ACK);
+	stream.Write(m_header.sequence);
+	stream.Write(m_header.chunkIndex);
+}
+
+static bool sameFormat(const SnapshotFormat& a, const SnapshotFormat& b) {
+	return a.arenaRadius == b.arenaRadius && a.maxVelocity == b.maxVelocity &&
+		a.positionBits == b.positionBits && a.velocityBits == b.velocityBits;
+}
+
+SnapshotReceiver::Result SnapshotReceiver::receive(RakNet::BitStream& stream) {
+
+	m_chunkEntities = nullptr;
+	m_chunkEntityCount = 0;
+	m_completedSnapshot = false;
+
+	SnapshotHeader& header = m_header;
+	if (!header.read(stream))
+		return SNAPSHOT_MALFORMED;
+
+	// only keyframe chunks carry the layout, nothing decoded with another one lines up with it
+	if (header.hasBaseline) {
+		if (!m_hasLayout)
+			return SNAPSHOT_NO_BASELINE;
+		header.totalEntities = m_totalEntities;
+		header.entitiesPerChunk = m_entitiesPerChunk;
+		header.format = m_format;
+	}
+	if (!header.placeChunk())
+		return SNAPSHOT_MALFORMED;
+	if (!m_hasLayout || header.totalEntities != m_totalEntities || header.entitiesPerChunk != m_entitiesPerChunk ||
+		!sameFormat(header.format, m_format)) {
+		for (auto& slot : m_slots)
+			slot.valid = false;
+		m_hasLayout = true;
+		m_totalEntities = header.totalEntities;
+		m_entitiesPerChunk = header.entitiesPerChunk;
+		m_format = header.format;
+	}
+
+	// too old to keep, storing it would replace a newer baseline, or a chunk we already have
+	m_arrival = m_window.classify(header);
+	if (m_arrival == SnapshotReceiveWindow::ARRIVAL_STALE)
+		return SNAPSHOT_STALE;
+	if (m_arrival == SnapshotReceiveWindow::ARRIVAL_DUPLICATE)
+		return SNAPSHOT_DUPLICATE;
+
+	Slot& slot = m_slots[header.sequence % SNAPSHOT_HISTORY];
+	if (!slot.valid || slot.sequence != header.sequence) {
+		slot.sequence = header.sequence;
+		slot.valid = true;
+		slot.chunksReceived = 0;
+		slot.chunkReceived.assign(header.chunkCount, 0);
+		slot.entities.resize(header.totalEntities);
+	}
+	if (slot.chunkReceived[header.chunkIndex])
+		return SNAPSHOT_DUPLICATE;
+
+	// a delta needs the same range of its baseline, the rest of that snapshot doesn't matter
+	const QuantizedEntity* baseline = nullptr;
+	if (header.hasBaseline) {
+		const Slot& base = m_slots[header.baselineSequence % SNAPSHOT_HISTORY];
+		if (!base.valid || base.sequence != header.baselineSequence || !base.chunkReceived[header.chunkIndex])
+			return SNAPSHOT_NO_BASELINE;
+		baseline = base.entities.data() + header.firstEntity;
+	}
+
+	// the chunk has to fill its whole range
+	QuantizedEntity* chunk = slot.entities.data() + header.firstEntity;
+	unsigned int rangeCount = header.totalEntities - header.firstEntity;
+	if (rangeCount > header.entitiesPerChunk)
+		rangeCount = header.entitiesPerChunk;
+	if (m_chunkUpdated.size() < rangeCount)
+		m_chunkUpdated.resize(rangeCount);
+	unsigned int count = 0;
+	if (!readSnapshotEntities(stream, header.format, baseline, chunk, m_chunkUpdated.data(), rangeCount, count) ||
+		count != rangeCount)
+		return SNAPSHOT_MALFORMED;
+
+	slot.chunkReceived[header.chunkIndex] = 1;
+	m_completedSnapshot = ++slot.chunksReceived == slot.chunkReceived.size();
+
+	m_chunkEntities = chunk;
+	m_chunkEntityCount = count;
+	return SNAPSHOT_CHUNK_DECODED;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <BitStream.h>
+#include <RakNetTime.h>
+
+#include "../src/Snapshot.h"
+#include "../src/SnapshotReceiveWindow.h"
+
+// client side of the snapshot protocol
+// decodes ID_ENTITY_LIST chunks and keeps each one's range as a delta baseline for the same range of later snapshots
+class SnapshotReceiver {
+public:
+
+	enum Result {
+		SNAPSHOT_CHUNK_DECODED,	// chunkEntities() holds the chunk's range of entities
+		SNAPSHOT_DUPLICATE,		// already have this chunk
+		SNAPSHOT_STALE,			// too old to store without replacing a newer baseline
+		SNAPSHOT_NO_BASELINE,	// delta against a snapshot we no longer have
+		SNAPSHOT_MALFORMED,
+	};
+
+	SnapshotReceiver();
+
+	void				clear();
+
+	// stream must be positioned just after the timestamp
+	Result				receive(RakNet::BitStream& stream);
+
+	// a whole ID_ENTITY_LIST packet as it arrives, [ ID_ENTITY_LIST, RakNet::Time, chunk ], the time is on the server's clock
+	Result				receivePacket(const unsigned char* data, unsigned int length, RakNet::Time& timestamp);
+
+	// the ID_SNAPSHOT_ACK to send back for each decoded chunk, so the server can delta the chunk's range against it
+	void				writeAck(RakNet::BitStream& stream) const;
+
+	// after SNAPSHOT_CHUNK_DECODED, the header of the chunk and its entities
+	// entities are [header().firstEntity, header().firstEntity + chunkEntityCount())
+	const SnapshotHeader&	header() const				{ return m_header; }
+	const QuantizedEntity*	chunkEntities() const		{ return m_chunkEntities; }
+	unsigned int			chunkEntityCount() const	{ return m_chunkEntityCount; }
+
+	// per chunk entity, 0 if the server left it out this snapshot and its value is carried over from an older one
+	const unsigned char*	chunkUpdated() const		{ return m_chunkUpdated.data(); }
+
+	// true if the last chunk was the last of its snapshot to arrive
+	bool				completedSnapshot() const		{ return m_completedSnapshot; }
+
+	// how the last chunk arrived, classified before any entity was decoded, and the running counts
+	SnapshotReceiveWindow::Arrival	arrival() const		{ return m_arrival; }
+	const SnapshotReceiveStats&		stats() const		{ return m_window.stats(); }
+
+private:
+
+	// the last SNAPSHOT_HISTORY snapshots, each range only holds a value once its chunk has arrived
+	struct Slot {
+		unsigned int					sequence;
+		bool							valid;
+		unsigned int					chunksReceived;
+		std::vector<unsigned char>		chunkReceived;
+		std::vector<QuantizedEntity>	entities;
+	};
+	Slot				m_slots[SNAPSHOT_HISTORY];
+
+	// the layout the slots were decoded with, from the last keyframe chunk, delta chunks are read with it
+	// a keyframe chunk with a different one throws the slots away
+	bool				m_hasLayout;
+	unsigned int		m_totalEntities;
+	unsigned int		m_entitiesPerChunk;
+	SnapshotFormat		m_format;
+
+	// rejects stale and duplicate chunks up front and counts late, gaps and loss
+	SnapshotReceiveWindow			m_window;
+	SnapshotReceiveWindow::Arrival	m_arrival;
+
+	SnapshotHeader			m_header;
+	const QuantizedEntity*	m_chunkEntities;
+	unsigned int			m_chunkEntityCount;
+
+	// only grows, to the largest chunk seen
+	std::vector<unsigned char>	m_chunkUpdated;
+	bool					m_completedSnapshot;
+};
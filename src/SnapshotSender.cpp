@@ -0,0 +1,197 @@
+#include "SnapshotSender.h"
+
+void writeSnapshotChunk(RakNet::BitStream& stream, SnapshotHeader& header, const SnapshotDelta& delta, unsigned int chunk) {
+
+	const SnapshotChunkDelta& chunkDelta = delta.chunks[chunk];
+	header.hasBaseline = chunkDelta.baseline != nullptr;
+	header.baselineSequence = chunkDelta.baselineSequence;
+	header.chunkIndex = (unsigned short)chunk;
+	header.totalEntities = delta.entityCount;
+	header.entitiesPerChunk = delta.entitiesPerChunk;
+	header.chunkCount = (unsigned short)delta.chunkCount;
+	header.firstEntity = chunk * delta.entitiesPerChunk;
+
+	unsigned int first = header.firstEntity;
+	unsigned int count = delta.entityCount - first < delta.entitiesPerChunk ? delta.entityCount - first : delta.entitiesPerChunk;
+	header.write(stream);
+	writeSnapshotEntities(stream, header.format, delta.entities + first,
+		chunkDelta.baseline != nullptr ? chunkDelta.baseline + first : nullptr,
+		delta.updated != nullptr ? delta.updated + first : nullptr, count);
+}
+
+SnapshotSender::SnapshotSender() {
+	clear();
+}
+
+void SnapshotSender::clear() {
+	for (auto& frame : m_frames) {
+		frame.sequence = 0;
+		frame.valid = false;
+	}
+	m_entitiesPerChunk = 0;
+	for (auto& chunk : m_chunks) {
+		chunk.hasAck = false;
+		chunk.ackedSequence = 0;
+		chunk.base = nullptr;
+	}
+}
+
+void SnapshotSender::acknowledge(unsigned int sequence, unsigned int chunk) {
+	if (chunk >= m_chunks.size())
+		return;
+
+	// acks can arrive out of order, only ever move the range's baseline forward
+	ChunkState& state = m_chunks[chunk];
+	if (!state.hasAck || sequenceGreater(sequence, state.ackedSequence)) {
+		state.hasAck = true;
+		state.ackedSequence = sequence;
+	}
+}
+
+void SnapshotSender::selectBaseline(const SnapshotHistory& history, unsigned int sequence, unsigned int entitiesPerChunk,
+	std::vector<QuantizedEntity>& baselineScratch, SnapshotDelta& delta) {
+
+	unsigned int count = (unsigned int)history.find(sequence)->size();
+	unsigned int chunkCount = snapshotChunkCount(count, entitiesPerChunk);
+
+	// different ranges don't line up with anything the client holds
+	if (entitiesPerChunk != m_entitiesPerChunk || chunkCount != m_chunks.size()) {
+		clear();
+		m_entitiesPerChunk = entitiesPerChunk;
+		m_chunks.resize(chunkCount, ChunkState{ false, 0, nullptr });
+		m_chunkDeltas.resize(chunkCount);
+	}
+
+	delta.chunks = m_chunkDeltas.data();
+	delta.chunkCount = chunkCount;
+	delta.entitiesPerChunk = entitiesPerChunk;
+	delta.entityCount = count;
+	delta.hasBaseline = false;
+
+	baselineScratch.resize(count);
+	const QuantizedEntity* snapshots[SNAPSHOT_HISTORY] = {};
+
+	for (unsigned int c = 0; c < chunkCount; ++c) {
+		ChunkState& state = m_chunks[c];
+		SnapshotChunkDelta& chunk = m_chunkDeltas[c];
+
+		// the frame the range was acknowledged in is a usable baseline while every value in the range can still be looked up
+		state.base = nullptr;
+		if (state.hasAck && sequence - state.ackedSequence < SNAPSHOT_HISTORY) {
+			const Frame& frame = m_frames[state.ackedSequence % SNAPSHOT_HISTORY];
+			if (frame.valid && frame.sequence == state.ackedSequence &&
+				sequence - frame.oldestSource[c] < SNAPSHOT_HISTORY &&
+				history.find(frame.sequence) != nullptr)
+				state.base = &frame;
+		}
+
+		if (state.base == nullptr) {
+			chunk.baseline = nullptr;
+			chunk.baselineSequence = 0;
+			chunk.shared = true;
+			continue;
+		}
+
+		delta.hasBaseline = true;
+		chunk.baselineSequence = state.base->sequence;
+
+		// the values the client holds in the range
+		chunk.shared = state.base->uniform[c] != 0;
+		if (chunk.shared) {
+			chunk.baseline = history.find(state.base->sequence)->data();
+			continue;
+		}
+
+		unsigned int first = c * entitiesPerChunk;
+		unsigned int end = first + entitiesPerChunk < count ? first + entitiesPerChunk : count;
+		for (unsigned int i = first; i < end; ++i) {
+			unsigned int source = state.base->sources[i];
+			const QuantizedEntity*& snapshot = snapshots[source % SNAPSHOT_HISTORY];
+			if (snapshot == nullptr)
+				snapshot = history.find(source)->data();
+			baselineScratch[i] = snapshot[i];
+		}
+		chunk.baseline = baselineScratch.data();
+	}
+}
+
+void SnapshotSender::selectEntities(const SnapshotHistory& history, const SnapshotFormat& format, unsigned int sequence, const unsigned char* relevant,
+	std::vector<QuantizedEntity>& entityScratch, SnapshotDelta& delta) {
+
+	const std::vector<QuantizedEntity>& current = *history.find(sequence);
+	unsigned int count = delta.entityCount;
+	unsigned int perChunk = delta.entitiesPerChunk;
+
+	Frame& frame = m_frames[sequence % SNAPSHOT_HISTORY];
+	frame.sequence = sequence;
+	frame.valid = true;
+	frame.uniform.assign(delta.chunkCount, 1);
+	frame.oldestSource.assign(delta.chunkCount, sequence);
+
+	// sized even when it isn't needed, so a slot's first partial send doesn't allocate long after the rest
+	frame.sources.resize(count);
+
+	// a delta can be bigger than the range in full when most of it has changed a lot
+	delta.hasBaseline = false;
+	for (unsigned int c = 0; c < delta.chunkCount; ++c) {
+		SnapshotChunkDelta& chunk = m_chunkDeltas[c];
+		if (chunk.baseline == nullptr)
+			continue;
+
+		unsigned int first = c * perChunk;
+		unsigned int end = first + perChunk < count ? first + perChunk : count;
+		unsigned int bits = 0;
+		for (unsigned int i = first; i < end; ++i)
+			bits += relevant == nullptr || relevant[i] ? snapshotEntityBits(format, current[i], &chunk.baseline[i]) : SNAPSHOT_UNCHANGED_BITS;
+
+		if (bits > (end - first) * format.entityBits()) {
+			chunk.baseline = nullptr;
+			chunk.baselineSequence = 0;
+			chunk.shared = true;
+			m_chunks[c].base = nullptr;
+		}
+		else
+			delta.hasBaseline = true;
+	}
+
+	if (relevant == nullptr) {
+		delta.entities = current.data();
+		delta.updated = nullptr;
+		return;
+	}
+
+	// only some entities are sent, the rest carry over the baseline's value and where it came from
+	entityScratch.resize(count);
+	for (unsigned int c = 0; c < delta.chunkCount; ++c) {
+		SnapshotChunkDelta& chunk = m_chunkDeltas[c];
+		unsigned int first = c * perChunk;
+		unsigned int end = first + perChunk < count ? first + perChunk : count;
+
+		// keyframes carry every entity regardless of relevance so the client has a known value for each from here on
+		if (chunk.baseline == nullptr) {
+			for (unsigned int i = first; i < end; ++i)
+				entityScratch[i] = current[i];
+			continue;
+		}
+
+		const Frame& base = *m_chunks[c].base;
+		for (unsigned int i = first; i < end; ++i) {
+			if (relevant[i]) {
+				entityScratch[i] = current[i];
+				frame.sources[i] = sequence;
+			}
+			else {
+				unsigned int source = sourceOf(base, i);
+				entityScratch[i] = chunk.baseline[i];
+				frame.sources[i] = source;
+				frame.uniform[c] = 0;
+				if (sequenceGreater(frame.oldestSource[c], source))
+					frame.oldestSource[c] = source;
+			}
+		}
+		if (!frame.uniform[c])
+			chunk.shared = false;
+	}
+	delta.entities = entityScratch.data();
+	delta.updated = relevant;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <BitStream.h>
+
+#include "../src/Snapshot.h"
+
+// what to encode for one chunk's range of entities
+struct SnapshotChunkDelta
+{
+	// the values the client holds for the range, indexed by entity like SnapshotDelta::entities, nullptr for a keyframe
+	const QuantizedEntity*	baseline;
+	unsigned int			baselineSequence;
+
+	// the range's entities and baseline are straight from the snapshot history, so every client
+	// with the same baseline sequence for this chunk is sent exactly the same thing
+	bool					shared;
+};
+
+// what to encode for one client this tick
+struct SnapshotDelta
+{
+	const QuantizedEntity*	entities;
+
+	// per entity, 0 where it was left out and carries over the baseline's value, nullptr when every entity is this tick's
+	const unsigned char*	updated;
+
+	// one per range of entitiesPerChunk entities, each sent in its own packet against its own baseline
+	const SnapshotChunkDelta*	chunks;
+	unsigned int			chunkCount;
+	unsigned int			entitiesPerChunk;
+	unsigned int			entityCount;
+
+	// at least one chunk has a baseline
+	bool					hasBaseline;
+
+	// the client's value of an entity, nullptr if its chunk is a keyframe
+	const QuantizedEntity*	baselineOf(unsigned int entity) const
+	{
+		const QuantizedEntity* baseline = chunks[entity / entitiesPerChunk].baseline;
+		return baseline != nullptr ? &baseline[entity] : nullptr;
+	}
+};
+
+// writes the header and entities of one of delta's chunks, header's per chunk fields are filled in
+void	writeSnapshotChunk(RakNet::BitStream& stream, SnapshotHeader& header, const SnapshotDelta& delta, unsigned int chunk);
+
+// server side of the snapshot protocol for one client
+// each chunk's range is acknowledged on its own, so the client holds each range from whichever snapshot it last got it in
+// when a client is only sent some entities, the ranges it holds also mix values from different ticks,
+// so every frame sent records which snapshot each entity's value came from and deltas are made against that
+class SnapshotSender {
+public:
+
+	SnapshotSender();
+
+	void	clear();
+
+	// the client has decoded this chunk of the snapshot
+	void	acknowledge(unsigned int sequence, unsigned int chunk);
+
+	// picks the baselines for snapshot sequence and what to send against them, in two steps so what is relevant
+	// can be chosen with the baselines in hand
+	// selectBaseline splits the snapshot into ranges of entitiesPerChunk and fills in delta's chunks and hasBaseline,
+	// a range goes as a keyframe when the client has no usable value for it
+	// selectEntities takes relevant, marking the entities worth sending this tick, nullptr sends all of them
+	// entities that aren't sent keep the client's baseline value, so they encode as unchanged and are marked as not updated
+	// a range whose delta would be bigger than the range in full goes as a keyframe instead, so every chunk fits
+	// in a packet sized for a keyframe chunk
+	// the scratch arrays are only used when the client holds or is sent a subset
+	void	selectBaseline(const SnapshotHistory& history, unsigned int sequence, unsigned int entitiesPerChunk,
+				std::vector<QuantizedEntity>& baselineScratch, SnapshotDelta& delta);
+	void	selectEntities(const SnapshotHistory& history, const SnapshotFormat& format, unsigned int sequence, const unsigned char* relevant,
+				std::vector<QuantizedEntity>& entityScratch, SnapshotDelta& delta);
+
+	// the snapshot the client's baseline value of an entity came from, only valid for an entity in a chunk with a baseline
+	unsigned int	baselineSource(unsigned int entity) const { return sourceOf(*m_chunks[entity / m_entitiesPerChunk].base, entity); }
+
+private:
+
+	struct Frame {
+		unsigned int				sequence;
+		bool						valid;
+
+		// per chunk, every value in the range came from snapshot sequence and its sources are left unset
+		std::vector<unsigned char>	uniform;
+
+		// per chunk, oldest snapshot any value in the range came from, the range is only a usable baseline while that is still in the history
+		std::vector<unsigned int>	oldestSource;
+		std::vector<unsigned int>	sources;
+	};
+
+	unsigned int	sourceOf(const Frame& frame, unsigned int entity) const
+	{
+		return frame.uniform[entity / m_entitiesPerChunk] ? frame.sequence : frame.sources[entity];
+	}
+
+	Frame			m_frames[SNAPSHOT_HISTORY];
+	unsigned int	m_entitiesPerChunk;
+
+	// per chunk, the newest snapshot the client has acknowledged the range in and the frame selectBaseline chose, nullptr for a keyframe
+	struct ChunkState {
+		bool			hasAck;
+		unsigned int	ackedSequence;
+		const Frame*	base;
+	};
+	std::vector<ChunkState>			m_chunks;
+	std::vector<SnapshotChunkDelta>	m_chunkDeltas;
+};
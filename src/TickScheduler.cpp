@@ -0,0 +1,219 @@
+#include "TickScheduler.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#endif
+
+TickScheduler::TickScheduler()
+	: m_start(std::chrono::steady_clock::now()) {
+#if defined(_WIN32)
+	// default timer resolution is 15.6ms, far coarser than a tick
+	timeBeginPeriod(1);
+
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+	SOCKET wakeSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	if (wakeSocket != INVALID_SOCKET && bind(wakeSocket, (sockaddr*)&address, sizeof(address)) != 0) {
+		closesocket(wakeSocket);
+		wakeSocket = INVALID_SOCKET;
+	}
+	m_wakeSocket = (uintptr_t)wakeSocket;
+#else
+	m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	m_wakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+}
+
+TickScheduler::~TickScheduler() {
+#if defined(_WIN32)
+	if ((SOCKET)m_wakeSocket != INVALID_SOCKET)
+		closesocket((SOCKET)m_wakeSocket);
+	WSACleanup();
+	timeEndPeriod(1);
+#else
+	if (m_timer >= 0)
+		close(m_timer);
+	if (m_wakeEvent >= 0)
+		close(m_wakeEvent);
+#endif
+}
+
+uint64_t TickScheduler::now() const {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+bool TickScheduler::waitUntil(uint64_t deadline) {
+
+	uint64_t time = now();
+	if (time + SPIN_MICROSECONDS < deadline) {
+		if (!sleepUntil(deadline - SPIN_MICROSECONDS))
+			return false;
+	}
+
+	// the OS can't be trusted for the last stretch
+	while (now() < deadline) {}
+	return true;
+}
+
+#if defined(_WIN32)
+
+void TickScheduler::wake() {
+	SOCKET wakeSocket = (SOCKET)m_wakeSocket;
+	if (wakeSocket == INVALID_SOCKET)
+		return;
+	sockaddr_in address;
+	int length = sizeof(address);
+	if (getsockname(wakeSocket, (sockaddr*)&address, &length) == 0) {
+		char byte = 0;
+		sendto(wakeSocket, &byte, 1, 0, (sockaddr*)&address, length);
+	}
+}
+
+bool TickScheduler::sleepUntil(uint64_t deadline) {
+
+	uint64_t time = now();
+	if (time >= deadline)
+		return true;
+	uint64_t wait = deadline - time;
+
+	SOCKET wakeSocket = (SOCKET)m_wakeSocket;
+	if (wakeSocket == INVALID_SOCKET) {
+		Sleep((DWORD)(wait / 1000));
+		return true;
+	}
+
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(wakeSocket, &readable);
+	timeval timeout;
+	timeout.tv_sec = (long)(wait / 1000000);
+	timeout.tv_usec = (long)(wait % 1000000);
+	if (select(0, &readable, nullptr, nullptr, &timeout) <= 0)
+		return true;
+
+	// drain the wake datagrams
+	char buffer[16];
+	u_long pending = 0;
+	while (ioctlsocket(wakeSocket, FIONREAD, &pending) == 0 && pending > 0)
+		recv(wakeSocket, buffer, sizeof(buffer), 0);
+	return false;
+}
+
+#else
+
+void TickScheduler::wake() {
+	if (m_wakeEvent < 0)
+		return;
+	uint64_t one = 1;
+	ssize_t bytes = write(m_wakeEvent, &one, sizeof(one));
+	(void)bytes;
+}
+
+bool TickScheduler::sleepUntil(uint64_t deadline) {
+
+	// the deadline is on our own clock, turn it into an absolute CLOCK_MONOTONIC time
+	uint64_t time = now();
+	if (time >= deadline)
+		return true;
+	timespec monotonic;
+	clock_gettime(CLOCK_MONOTONIC, &monotonic);
+	uint64_t wakeTime = (uint64_t)monotonic.tv_sec * 1000000000ull + (uint64_t)monotonic.tv_nsec + (deadline - time) * 1000ull;
+	timespec absolute;
+	absolute.tv_sec = (time_t)(wakeTime / 1000000000ull);
+	absolute.tv_nsec = (long)(wakeTime % 1000000000ull);
+
+	if (m_timer < 0) {
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &absolute, nullptr) != 0) {}
+		return true;
+	}
+
+	// wait on the timer and wake event together, poll's own timeout is only millisecond precise
+	itimerspec timer;
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value = absolute;
+	timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &timer, nullptr);
+
+	pollfd fds[2];
+	nfds_t count = 0;
+	fds[count].fd = m_timer;
+	fds[count].events = POLLIN;
+	fds[count++].revents = 0;
+	if (m_wakeEvent >= 0) {
+		fds[count].fd = m_wakeEvent;
+		fds[count].events = POLLIN;
+		fds[count++].revents = 0;
+	}
+	if (poll(fds, count, -1) <= 0)
+		return true;
+
+	bool woken = false;
+	for (nfds_t i = 0; i < count; ++i) {
+		if ((fds[i].revents & POLLIN) == 0)
+			continue;
+		uint64_t value;
+		ssize_t bytes = read(fds[i].fd, &value, sizeof(value));
+		(void)bytes;
+		if (fds[i].fd == m_wakeEvent)
+			woken = true;
+	}
+	return !woken;
+}
+
+#endif
+
+void TickJitter::reset() {
+	m_count = 0;
+	m_sum = 0;
+	m_sumSquares = 0;
+	m_worst = 0;
+	memset(m_buckets, 0, sizeof(m_buckets));
+}
+
+void TickJitter::record(uint64_t lateMicroseconds) {
+	++m_count;
+	m_sum += (double)lateMicroseconds;
+	m_sumSquares += (double)lateMicroseconds * (double)lateMicroseconds;
+	if (lateMicroseconds > m_worst)
+		m_worst = lateMicroseconds;
+
+	uint64_t bucket = lateMicroseconds / BUCKET_MICROSECONDS;
+	++m_buckets[bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1];
+}
+
+void TickJitter::print(std::ostream& out) const {
+	if (m_count == 0)
+		return;
+
+	double mean = m_sum / m_count;
+	double deviation = sqrt(std::max(0.0, m_sumSquares / m_count - mean * mean));
+
+	// upper edge of the bucket the 99th percentile falls in
+	unsigned int target = m_count - m_count / 100;
+	unsigned int seen = 0, percentile = 0;
+	for (unsigned int i = 0; i < BUCKET_COUNT; ++i) {
+		seen += m_buckets[i];
+		if (seen >= target) {
+			percentile = (i + 1) * BUCKET_MICROSECONDS;
+			break;
+		}
+	}
+
+	out << "Tick lateness over " << m_count << " ticks in us - mean: " << mean << ", deviation: " << deviation
+		<< ", 99th percentile: <" << percentile << ", worst: " << m_worst << std::endl;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// puts the server loop to sleep until its next deadline instead of spinning on the clock
+// sleeps through the OS until just before the deadline then spins the last SPIN_MICROSECONDS,
+// and wakes early if another thread calls wake
+class TickScheduler {
+public:
+
+	TickScheduler();
+	~TickScheduler();
+
+	// microseconds since the scheduler was created, on a monotonic clock
+	uint64_t	now() const;
+
+	// sleeps until the time given by now(), or returns straight away if it has passed
+	// returns false if woken by wake
+	bool		waitUntil(uint64_t deadline);
+
+	// OS sleep only, for loops that can be late by the OS's overshoot, returns false if woken by wake
+	bool		sleepUntil(uint64_t deadline);
+
+	// ends the current or next wait early, safe to call from any thread
+	void		wake();
+
+	// OS sleeps overshoot by tens of microseconds on Linux and up to a millisecond on Windows
+#if defined(_WIN32)
+	static const uint64_t	SPIN_MICROSECONDS = 1500;
+#else
+	static const uint64_t	SPIN_MICROSECONDS = 200;
+#endif
+
+private:
+
+	std::chrono::steady_clock::time_point	m_start;
+
+#if defined(_WIN32)
+	// select only waits on sockets, so wake sends a datagram to one bound to loopback
+	uintptr_t								m_wakeSocket;
+#else
+	// absolute timer the sleep waits on, and an eventfd for wake
+	int										m_timer;
+	int										m_wakeEvent;
+#endif
+};
+
+// how late each tick started against its schedule
+class TickJitter {
+public:
+
+	TickJitter() { reset(); }
+
+	void	reset();
+	void	record(uint64_t lateMicroseconds);
+
+	unsigned int	count() const { return m_count; }
+
+	// count, mean, standard deviation, 99th percentile and worst lateness in microseconds
+	void	print(std::ostream& out) const;
+
+private:
+
+	// 10us buckets up to 10ms, anything later lands in the last one
+	static const unsigned int	BUCKET_MICROSECONDS = 10;
+	static const unsigned int	BUCKET_COUNT = 1000;
+
+	unsigned int	m_count;
+	double			m_sum;
+	double			m_sumSquares;
+	uint64_t		m_worst;
+	unsigned int	m_buckets[BUCKET_COUNT];
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+
+// hands the newest of a stream of values from one producer thread to one consumer thread without locks
+// the producer fills back() and publishes it, the consumer takes the newest published value with acquire()
+// three slots means neither side ever waits, values published faster than they are acquired are skipped
+// slots are reused, so containers in T keep their capacity and nothing allocates once they have grown
+template <typename T>
+class TripleBuffer {
+public:
+
+	TripleBuffer() : m_back(0), m_middle(1), m_front(2) {}
+
+	// producer side, the slot to fill next, it holds whatever was published two values ago
+	T&		back()				{ return m_slots[m_back]; }
+
+	// producer side, swaps back() with the middle slot for the consumer to pick up
+	void	publish() {
+		m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// producer side, true once the consumer has acquired the last value published, or before any has been
+	bool	consumed() const {
+		return (m_middle.load(std::memory_order_relaxed) & FRESH) == 0;
+	}
+
+	// consumer side, swaps front() with the middle slot if something newer was published
+	// returns false and leaves front() alone if nothing has been since the last acquire
+	bool	acquire() {
+		if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0)
+			return false;
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// consumer side, the newest value acquired
+	const T&	front() const	{ return m_slots[m_front]; }
+
+private:
+
+	// the middle slot's index with a bit saying it has not been acquired yet
+	static const unsigned int	INDEX = 3;
+	static const unsigned int	FRESH = 4;
+
+	T							m_slots[3];
+	unsigned int				m_back;
+	std::atomic<unsigned int>	m_middle;
+	unsigned int				m_front;
+};
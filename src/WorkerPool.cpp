@@ -0,0 +1,84 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned int workerCount)
+	: m_workerCount(workerCount > 0 ? workerCount : 1),
+	m_job(nullptr),
+	m_generation(0),
+	m_pending(0),
+	m_quit(false)
+{
+	for (unsigned int i = 1; i < m_workerCount; ++i)
+		m_threads.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+}
+
+WorkerPool::~WorkerPool() {
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_startCondition.notify_all();
+
+	for (auto& t : m_threads)
+		t.join();
+}
+
+void WorkerPool::run(const Job& job) {
+
+	if (m_threads.empty()) {
+		job(0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job = &job;
+		m_pending = (unsigned int)m_threads.size();
+		++m_generation;
+	}
+	m_startCondition.notify_all();
+
+	job(0);
+
+	// barrier, every worker has to finish before the caller carries on
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this]() { return m_pending == 0; });
+	m_job = nullptr;
+}
+
+void WorkerPool::getRange(unsigned int worker, unsigned int count, unsigned int alignment, unsigned int& first, unsigned int& rangeCount) const {
+
+	unsigned int blocks = (count + alignment - 1) / alignment;
+	unsigned int blockFirst = (unsigned int)((unsigned long long)blocks * worker / m_workerCount);
+	unsigned int blockLast = (unsigned int)((unsigned long long)blocks * (worker + 1) / m_workerCount);
+
+	first = blockFirst * alignment < count ? blockFirst * alignment : count;
+	unsigned int last = blockLast * alignment < count ? blockLast * alignment : count;
+	rangeCount = last - first;
+}
+
+void WorkerPool::workerLoop(unsigned int worker) {
+
+	unsigned int seenGeneration = 0;
+
+	while (true) {
+
+		const Job* job = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_startCondition.wait(lock, [&]() { return m_quit || m_generation != seenGeneration; });
+			if (m_quit)
+				return;
+			seenGeneration = m_generation;
+			job = m_job;
+		}
+
+		(*job)(worker);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_pending;
+		}
+		m_doneCondition.notify_one();
+	}
+}
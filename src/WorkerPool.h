@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// persistent pool of worker threads that all run the same job once per dispatch
+// the calling thread takes part as worker 0, so a pool of 1 spawns no threads at all
+class WorkerPool {
+public:
+
+	typedef std::function<void(unsigned int worker)>	Job;
+
+	WorkerPool(unsigned int workerCount);
+	~WorkerPool();
+
+	unsigned int	workerCount() const { return m_workerCount; }
+
+	// runs job on every worker and returns once they have all finished
+	void			run(const Job& job);
+
+	// splits [0, count) into one contiguous range per worker, boundaries rounded to multiples of alignment
+	void			getRange(unsigned int worker, unsigned int count, unsigned int alignment, unsigned int& first, unsigned int& rangeCount) const;
+
+private:
+
+	void			workerLoop(unsigned int worker);
+
+	unsigned int				m_workerCount;
+	std::vector<std::thread>	m_threads;
+
+	std::mutex					m_mutex;
+	std::condition_variable		m_startCondition;
+	std::condition_variable		m_doneCondition;
+
+	const Job*					m_job;
+	unsigned int				m_generation;
+	unsigned int				m_pending;
+	bool						m_quit;
+};